@@ -0,0 +1,366 @@
+#include "archive.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  const char ARCHIVE_MAGIC[8] = {'L','E','S','S','P','O','S','N'};
+  const std::uint32_t ARCHIVE_VERSION = 1;
+  const std::size_t HEADER_SIZE = 16;
+  const char INDEX_MAGIC[8] = {'L','E','S','S','P','I','D','X'};
+  const std::uint32_t INDEX_VERSION = 1;
+  const std::size_t INDEX_HEADER_SIZE = 32;
+  const std::size_t INDEX_MIN_SLOTS = 64;
+  // index slots hold record numbers plus one in 32 bits
+  const std::size_t MAX_RECORDS = 0xffffffffu;
+
+  bool write_all(int fd, const void* data, std::size_t size){
+    const char* p = static_cast<const char*>(data);
+    while(size > 0){
+      ssize_t written = write(fd, p, size);
+      if(written <= 0) return false;
+      p += written;
+      size -= written;
+    }
+    return true;
+  }
+}
+
+bool operator==(const PackedPosition & a, const PackedPosition & b){
+  return std::memcmp(a.bytes, b.bytes, PACKED_SIZE)==0;
+}
+
+/**
+ * @return FNV-1a over the packed bytes
+ */
+std::uint64_t packed_hash(const PackedPosition & p){
+  std::uint64_t h = 0xcbf29ce484222325ull;
+  for(std::uint8_t byte: p.bytes){
+    h ^= byte;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+/**
+ * Packs the position of a game, as laid out in archive.hpp.
+ * @param g the game
+ * @param out the packed position
+ * @return false if the board holds more pieces than the format has room for
+ */
+bool pack(Game & g, PackedPosition & out){
+  std::memset(out.bytes, 0, PACKED_SIZE);
+  std::uint64_t occupancy = g.board.occupancy();
+  int count = 0;
+  for(int square=0; square<StandardGeometry::squares; square++){
+    Piece* piece = g.board.at(square);
+    if(piece==nullptr) continue;
+    if(count==PACKED_MAX_PIECES) return false;
+    out.bytes[8 + count / 8] |= piece->color << (count % 8);
+    out.bytes[12 + count / 2] |= piece->name << (4 * (count % 2));
+    count++;
+  }
+  for(int i=0; i<8; i++) out.bytes[i] = occupancy >> (8 * i);
+  out.bytes[28] = g.get_turn();
+  return true;
+}
+
+/**
+ * Reads a packed position into one byte per square, as `position_codes` writes them,
+ * without building a game.
+ * @param p the packed position
+ * @param codes the piece code plus one on every square, zero when empty
+ * @return the player to move
+ */
+Color unpack_codes(const PackedPosition & p, std::uint8_t codes[StandardGeometry::squares]){
+  std::uint64_t occupancy = 0;
+  for(int i=0; i<8; i++) occupancy |= std::uint64_t(p.bytes[i]) << (8 * i);
+  int count = 0;
+  for(int square=0; square<StandardGeometry::squares; square++){
+    codes[square] = 0;
+    if(!(occupancy & StandardGeometry::bit(square)) || count==PACKED_MAX_PIECES) continue;
+    int color = (p.bytes[8 + count / 8] >> (count % 8)) & 1;
+    int name = (p.bytes[12 + count / 2] >> (4 * (count % 2))) & 0xf;
+    if(name < NUM_PIECES) codes[square] = color*NUM_PIECES + name + 1;
+    count++;
+  }
+  return Color(p.bytes[28] & 1);
+}
+
+/**
+ * @return the game a packed position describes, built from the shared canonical pieces
+ */
+Game unpack(const PackedPosition & p){
+  std::uint8_t codes[StandardGeometry::squares];
+  Color turn = unpack_codes(p, codes);
+  return codes_game(codes, turn);
+}
+
+
+PositionStore :: PositionStore():
+  fd{-1}
+  , mapping{nullptr}
+  , mapped_bytes{0}
+  , records{0}
+  , index_path{}
+  , index_fd{-1}
+  , index_mapping{nullptr}
+  , index_bytes{0}
+{}
+
+PositionStore :: ~PositionStore(){
+  close();
+}
+
+/**
+ * Opens a store, creating the file if it does not exist. A record cut short by a crash
+ * while appending is dropped. The index next to the store is opened too, and brought up to
+ * date with any records it does not cover yet; it is only rebuilt from the records when it
+ * is missing or does not match the store.
+ * @param path the store file
+ * @return whether the file could be opened and is a store
+ */
+bool PositionStore :: open(const std::string & path){
+  close();
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if(fd < 0){
+    std::cerr << path << ": " << std::strerror(errno) << "\n";
+    return false;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  std::size_t size = st.st_size;
+  if(size==0){
+    std::uint32_t header[2] = {ARCHIVE_VERSION, PACKED_SIZE};
+    if(!write_all(fd, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) || !write_all(fd, header, sizeof(header))){
+      std::cerr << path << ": could not write the header\n";
+      close();
+      return false;
+    }
+    size = HEADER_SIZE;
+  }
+  char magic[8];
+  std::uint32_t header[2];
+  if(pread(fd, magic, sizeof(magic), 0)!=sizeof(magic) || std::memcmp(magic, ARCHIVE_MAGIC, sizeof(magic))!=0
+     || pread(fd, header, sizeof(header), sizeof(magic))!=sizeof(header)){
+    std::cerr << path << ": not a position store\n";
+    close();
+    return false;
+  }
+  if(header[0]!=ARCHIVE_VERSION || header[1]!=PACKED_SIZE){
+    std::cerr << path << ": position store has the wrong version\n";
+    close();
+    return false;
+  }
+
+  std::size_t count = (size - HEADER_SIZE) / PACKED_SIZE;
+  if(HEADER_SIZE + count * PACKED_SIZE != size && ftruncate(fd, HEADER_SIZE + count * PACKED_SIZE)!=0){
+    close();
+    return false;
+  }
+  lseek(fd, 0, SEEK_END);
+  if(!map_records(count)){
+    close();
+    return false;
+  }
+  records = count;
+  index_path = path + ".index";
+  if(!open_index()){
+    std::cerr << index_path << ": " << std::strerror(errno) << "\n";
+    close();
+    return false;
+  }
+  return true;
+}
+
+void PositionStore :: close(){
+  close_index();
+  if(mapping!=nullptr) munmap(mapping, mapped_bytes);
+  if(fd >= 0) ::close(fd);
+  fd = -1;
+  mapping = nullptr;
+  mapped_bytes = 0;
+  records = 0;
+}
+
+bool PositionStore :: is_open() const{
+  return fd >= 0;
+}
+
+/*
+ * Makes sure the mapping covers `count` records. The mapping is grown in large steps past
+ * the end of the file, which is allowed as long as only bytes inside the file are read.
+ */
+bool PositionStore :: map_records(std::size_t count){
+  std::size_t needed = HEADER_SIZE + count * PACKED_SIZE;
+  if(needed <= mapped_bytes) return true;
+  std::size_t bytes = mapped_bytes==0 ? (1 << 20) : mapped_bytes;
+  while(bytes < needed) bytes *= 2;
+  if(mapping!=nullptr) munmap(mapping, mapped_bytes);
+  void* m = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  if(m==MAP_FAILED){
+    mapping = nullptr;
+    mapped_bytes = 0;
+    return false;
+  }
+  mapping = static_cast<std::uint8_t*>(m);
+  mapped_bytes = bytes;
+  return true;
+}
+
+/*
+ * Maps the index file if it belongs to this store, then indexes the records appended
+ * since it was last written. Otherwise, or when it is too full, writes a new one.
+ */
+bool PositionStore :: open_index(){
+  index_fd = ::open(index_path.c_str(), O_RDWR | O_CLOEXEC);
+  if(index_fd >= 0){
+    struct stat st;
+    fstat(index_fd, &st);
+    std::size_t bytes = st.st_size;
+    void* m = bytes >= INDEX_HEADER_SIZE ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd, 0)
+      : MAP_FAILED;
+    if(m!=MAP_FAILED){
+      index_mapping = static_cast<std::uint8_t*>(m);
+      index_bytes = bytes;
+    }
+  }
+  if(!index_matches()){
+    std::size_t slots = INDEX_MIN_SLOTS;
+    while(slots < 2 * records) slots *= 2;
+    return build_index(slots);
+  }
+  for(std::size_t record = index_header()->records; record < records; record++){
+    if(2 * (record + 1) > index_header()->slots && !build_index(2 * index_header()->slots)) return false;
+    if(index_header()->records <= record) index_record(record);
+  }
+  return true;
+}
+
+/*
+ * Whether the mapped index file is one and covers no records the store does not have.
+ * Its last indexed record must be found where it is, which catches an index left over
+ * from another store of the same name.
+ */
+bool PositionStore :: index_matches() const{
+  if(index_mapping==nullptr) return false;
+  const IndexHeader* h = index_header();
+  if(std::memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic))!=0 || h->version!=INDEX_VERSION
+     || h->slots < INDEX_MIN_SLOTS || (h->slots & (h->slots - 1))!=0
+     || index_bytes != INDEX_HEADER_SIZE + h->slots * sizeof(IndexSlot)
+     || h->records > records || 2 * h->records > h->slots) return false;
+  return h->records==0 || find(at(h->records - 1))==std::int64_t(h->records - 1);
+}
+
+/*
+ * Writes a new index with `slots` slots over every record next to the old one, then
+ * renames it over the old one and maps it in its place.
+ */
+bool PositionStore :: build_index(std::size_t slots){
+  std::string fresh = index_path + ".new";
+  std::size_t bytes = INDEX_HEADER_SIZE + slots * sizeof(IndexSlot);
+  int new_fd = ::open(fresh.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(new_fd < 0) return false;
+  void* m = ftruncate(new_fd, bytes)==0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, new_fd, 0)
+    : MAP_FAILED;
+  if(m==MAP_FAILED || std::rename(fresh.c_str(), index_path.c_str())!=0){
+    if(m!=MAP_FAILED) munmap(m, bytes);
+    ::close(new_fd);
+    unlink(fresh.c_str());
+    return false;
+  }
+  close_index();
+  index_fd = new_fd;
+  index_mapping = static_cast<std::uint8_t*>(m);
+  index_bytes = bytes;
+  IndexHeader* h = index_header();
+  std::memcpy(h->magic, INDEX_MAGIC, sizeof(h->magic));
+  h->version = INDEX_VERSION;
+  h->slots = slots;
+  h->records = 0;
+  for(std::size_t record=0; record<records; record++) index_record(record);
+  return true;
+}
+
+void PositionStore :: close_index(){
+  if(index_mapping!=nullptr) munmap(index_mapping, index_bytes);
+  if(index_fd >= 0) ::close(index_fd);
+  index_fd = -1;
+  index_mapping = nullptr;
+  index_bytes = 0;
+}
+
+PositionStore::IndexHeader* PositionStore :: index_header() const{
+  return reinterpret_cast<IndexHeader*>(index_mapping);
+}
+
+PositionStore::IndexSlot* PositionStore :: index_slots() const{
+  return reinterpret_cast<IndexSlot*>(index_mapping + INDEX_HEADER_SIZE);
+}
+
+/*
+ * Adds the next record to the index. The slot is written before the count, so an index
+ * cut short never claims a record it lacks.
+ */
+void PositionStore :: index_record(std::size_t record){
+  IndexSlot* slots = index_slots();
+  std::size_t mask = index_header()->slots - 1;
+  std::size_t slot = packed_hash(at(record)) & mask;
+  while(slots[slot]!=0) slot = (slot + 1) & mask;
+  slots[slot] = record + 1;
+  index_header()->records = record + 1;
+}
+
+/**
+ * @return the record number of a position, or -1 if it is not stored
+ */
+std::int64_t PositionStore :: find(const PackedPosition & p) const{
+  if(index_mapping==nullptr) return -1;
+  const IndexSlot* slots = index_slots();
+  std::size_t mask = index_header()->slots - 1;
+  for(std::size_t slot = packed_hash(p) & mask; slots[slot]!=0; slot = (slot + 1) & mask){
+    if(at(slots[slot] - 1)==p) return slots[slot] - 1;
+  }
+  return -1;
+}
+
+/**
+ * Adds a position unless it is already stored.
+ * @return the record number of the position, or -1 if it could not be written
+ */
+std::int64_t PositionStore :: append(const PackedPosition & p){
+  if(fd < 0 || records + 1 >= MAX_RECORDS) return -1;
+  std::int64_t existing = find(p);
+  if(existing >= 0) return existing;
+  // keep the index at most half full
+  if(2 * (records + 1) > index_header()->slots && !build_index(2 * index_header()->slots)) return -1;
+  if(!write_all(fd, p.bytes, PACKED_SIZE) || !map_records(records + 1)){
+    // drop whatever part of the record made it, so the next one still lines up
+    if(ftruncate(fd, HEADER_SIZE + records * PACKED_SIZE)==0) lseek(fd, 0, SEEK_END);
+    return -1;
+  }
+  records++;
+  index_record(records - 1);
+  return records - 1;
+}
+
+/**
+ * @param record a record number below `size()`
+ * @return the stored position, read straight from the mapping
+ */
+const PackedPosition & PositionStore :: at(std::size_t record) const{
+  return *reinterpret_cast<const PackedPosition*>(mapping + HEADER_SIZE + record * PACKED_SIZE);
+}
+
+/**
+ * @return the number of stored positions
+ */
+std::size_t PositionStore :: size() const{
+  return records;
+}
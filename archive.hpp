@@ -0,0 +1,96 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "chess.hpp"
+
+/**
+ * A position in 29 bytes, the same for equal positions so it can be compared and hashed
+ * bytewise:
+ *
+ *   bytes  0-7   occupancy, bit i set when square i holds a piece (little endian)
+ *   bytes  8-11  colour of each piece, bit k for the k-th occupied square
+ *   bytes 12-27  name of each piece, a nibble each, low nibble first
+ *   byte   28    side to move
+ *
+ * Unused bits are zero. Pieces are never added to a board, so 32 always suffice.
+ */
+constexpr int PACKED_SIZE = 29;
+constexpr int PACKED_MAX_PIECES = 32;
+
+struct PackedPosition{
+  std::uint8_t bytes[PACKED_SIZE];
+};
+
+bool operator==(const PackedPosition &, const PackedPosition &);
+std::uint64_t packed_hash(const PackedPosition &);
+bool pack(Game &, PackedPosition &);
+Game unpack(const PackedPosition &);
+Color unpack_codes(const PackedPosition &, std::uint8_t codes[StandardGeometry::squares]);
+
+
+/**
+ * An append-only file of packed positions, each stored once. The file is a 16 byte header,
+ * the magic "LESSPOSN" then version and record size as little endian uint32, followed by
+ * the records back to back, so position i is at byte 16 + 29 i and other programs can map
+ * it directly.
+ *
+ * Duplicate checks and lookups by position go through a hash index kept on disk next to
+ * the store, in a file named like it with ".index" added. That file is a 32 byte header,
+ * the magic "LESSPIDX", a uint32 version, four unused bytes, then the number of slots
+ * and the number of records indexed as uint64, followed by the slots: open addressing on
+ * `packed_hash`, each the record number plus one as uint32, zero when empty, at most
+ * half of them used. Both files are used through shared mappings, so opening a store
+ * reads neither and the pages of the index stay in the page cache rather than the heap.
+ * An index that is missing or does not match the store is rebuilt when it is opened, and
+ * one that lags behind, after a crash, is brought up to date. A store holds at most
+ * 2^32 - 2 positions.
+ *
+ * A store is not thread safe; callers that share one must lock around it.
+ */
+class PositionStore{
+public:
+  PositionStore();
+  ~PositionStore();
+  PositionStore(const PositionStore &) = delete;
+  PositionStore& operator=(const PositionStore &) = delete;
+
+  bool open(const std::string & path);
+  void close();
+  bool is_open() const;
+  std::int64_t append(const PackedPosition &);
+  std::int64_t find(const PackedPosition &) const;
+  const PackedPosition & at(std::size_t record) const;
+  std::size_t size() const;
+private:
+  struct IndexHeader{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t unused;
+    std::uint64_t slots;
+    std::uint64_t records;
+  };
+  using IndexSlot = std::uint32_t;
+
+  bool map_records(std::size_t count);
+  bool open_index();
+  bool index_matches() const;
+  bool build_index(std::size_t slots);
+  void close_index();
+  IndexHeader* index_header() const;
+  IndexSlot* index_slots() const;
+  void index_record(std::size_t record);
+
+  int fd;
+  std::uint8_t* mapping;
+  std::size_t mapped_bytes;
+  std::size_t records;
+  std::string index_path;
+  int index_fd;
+  // the index file: its header, then the slots
+  std::uint8_t* index_mapping;
+  std::size_t index_bytes;
+};
+
+#endif
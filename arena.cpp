@@ -0,0 +1,106 @@
+#include "arena.hpp"
+#include <algorithm>
+
+namespace {
+  thread_local Arena* current_arena = nullptr;
+}
+
+Arena :: Arena(std::size_t size):
+  blocks{}
+  , block{0}
+  , offset{0}
+  , block_size{size}
+{}
+
+/**
+ * Hands out `bytes` bytes aligned to `align` from the current block, moving on to the
+ * next block that is big enough (or making a new one) when it is full.
+ * @param bytes the number of bytes needed
+ * @param align the alignment of the returned pointer, a power of two
+ * @return a pointer that stays valid until the arena is released past it
+ */
+void* Arena :: allocate(std::size_t bytes, std::size_t align){
+  if(block < blocks.size()){
+    std::size_t start = (offset + align - 1) & ~(align - 1);
+    if(start + bytes <= blocks[block].size){
+      offset = start + bytes;
+      return blocks[block].memory.get() + start;
+    }
+  }
+  // Blocks past `block` are always unused, so any of them can take over.
+  std::size_t needed = bytes + align;
+  std::size_t next = blocks.empty() ? 0 : block + 1;
+  while(next < blocks.size() && blocks[next].size < needed) ++next;
+  if(next == blocks.size()){
+    std::size_t size = std::max(block_size, needed);
+    blocks.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+  }
+  block = next;
+  char* base = blocks[block].memory.get();
+  std::size_t address = reinterpret_cast<std::size_t>(base);
+  std::size_t start = ((address + align - 1) & ~(align - 1)) - address;
+  offset = start + bytes;
+  return base + start;
+}
+
+/**
+ * @return the current fill level, which can later be passed to `release`
+ */
+Arena::Mark Arena :: mark() const{
+  return Mark{block, offset};
+}
+
+/**
+ * Frees everything allocated since `m` was taken. The memory is kept for reuse.
+ * @param m a mark taken earlier from this arena
+ */
+void Arena :: release(Mark m){
+  block = m.block;
+  offset = m.offset;
+}
+
+/**
+ * Frees everything in the arena. The memory is kept for reuse.
+ */
+void Arena :: reset(){
+  release(Mark{0, 0});
+}
+
+/**
+ * @return the number of bytes the arena has taken from the heap
+ */
+std::size_t Arena :: capacity() const{
+  std::size_t total = 0;
+  for(const Block& b: blocks) total += b.size;
+  return total;
+}
+
+/**
+ * @return the arena installed by the innermost `ArenaScope` of this thread, or nullptr
+ */
+Arena* Arena :: current(){
+  return current_arena;
+}
+
+/**
+ * @return this thread's own arena, used by scopes that are not given one
+ */
+Arena& Arena :: local(){
+  thread_local Arena arena;
+  return arena;
+}
+
+ArenaScope :: ArenaScope(): ArenaScope(Arena::local()) {}
+
+ArenaScope :: ArenaScope(Arena& a):
+  arena{a}
+  , previous{current_arena}
+  , start{a.mark()}
+{
+  current_arena = &arena;
+}
+
+ArenaScope :: ~ArenaScope(){
+  arena.release(start);
+  current_arena = previous;
+}
@@ -0,0 +1,121 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * A bump allocator for short lived data such as move sets and per-ply scratch.
+ * Memory is handed out from large blocks and only reclaimed all at once, either
+ * by `reset` or by releasing back to a `Mark`. Blocks are kept around after a
+ * release, so once an arena has grown to the size a search needs it stops
+ * asking the heap for memory.
+ */
+class Arena{
+public:
+  struct Mark{
+    std::size_t block;
+    std::size_t offset;
+  };
+
+  explicit Arena(std::size_t block_size = 64 * 1024);
+  Arena(const Arena &) = delete;
+  Arena & operator=(const Arena &) = delete;
+
+  void* allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t));
+  Mark mark() const;
+  void release(Mark);
+  void reset();
+  std::size_t capacity() const;
+
+  static Arena* current();
+  static Arena& local();
+private:
+  struct Block{
+    std::unique_ptr<char[]> memory;
+    std::size_t size;
+  };
+  friend class ArenaScope;
+  std::vector<Block> blocks;
+  std::size_t block;
+  std::size_t offset;
+  std::size_t block_size;
+};
+
+
+/**
+ * Installs the calling thread's arena as the current one for the lifetime of the scope.
+ * Everything allocated through `ArenaAllocator` inside the scope is released when it ends,
+ * so nothing allocated in the scope may outlive it. That includes new nodes of a container
+ * made before the scope, so don't grow such containers inside one. Scopes can be nested.
+ */
+class ArenaScope{
+public:
+  ArenaScope();
+  explicit ArenaScope(Arena &);
+  ~ArenaScope();
+  ArenaScope(const ArenaScope &) = delete;
+  ArenaScope & operator=(const ArenaScope &) = delete;
+private:
+  Arena& arena;
+  Arena* previous;
+  Arena::Mark start;
+};
+
+
+/**
+ * A standard allocator that draws from the arena current when it was created,
+ * or from the heap when no arena is active.
+ */
+template <class T>
+struct ArenaAllocator{
+  using value_type = T;
+
+  ArenaAllocator(): arena{Arena::current()} {}
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U> & other): arena{other.arena} {}
+
+  T* allocate(std::size_t n){
+    if(arena!=nullptr) return static_cast<T*>(arena->allocate(n*sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n*sizeof(T)));
+  }
+  void deallocate(T* p, std::size_t){
+    if(arena==nullptr) ::operator delete(p);
+  }
+
+  Arena* arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b){
+  return a.arena == b.arena;
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> & a, const ArenaAllocator<U> & b){
+  return a.arena != b.arena;
+}
+
+/**
+ * Constructs a T in the current arena, or on the heap when no arena is active.
+ */
+template <class T, class... Args>
+T* arena_new(Args&&... args){
+  Arena* arena = Arena::current();
+  if(arena==nullptr) return new T(std::forward<Args>(args)...);
+  return new (arena->allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+/**
+ * Destroys a T made by `arena_new`. `from_arena` says which allocator produced it.
+ */
+template <class T>
+void arena_delete(T* p, bool from_arena){
+  if(p==nullptr) return;
+  if(from_arena) p->~T();
+  else delete p;
+}
+
+#endif
@@ -0,0 +1,269 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "nnue.hpp"
+
+namespace {
+  // positions handed to a thread at a time, a multiple of the vector width
+  const std::size_t BATCH_CHUNK = 256;
+
+  /*
+   * Counts every piece code in positions [begin, end), one pass per square and code.
+   */
+  void count_pieces(const PositionBatch & batch, BatchResults & r, std::size_t begin, std::size_t end){
+    for(int code=0; code<2*NUM_PIECES; code++){
+      std::uint8_t* out = r.counts[code].data();
+      std::fill(out + begin, out + end, 0);
+      for(int square=0; square<StandardGeometry::squares; square++){
+	const std::uint8_t* in = batch.squares[square].data();
+	const std::uint8_t wanted = code + 1;
+	for(std::size_t i=begin; i<end; i++) out[i] += in[i]==wanted;
+      }
+    }
+  }
+
+  void material(const PositionBatch & batch, BatchResults & r, std::size_t begin, std::size_t end){
+    std::int32_t* out = r.material.data();
+    std::fill(out + begin, out + end, 0);
+    for(int name=0; name<NUM_PIECES; name++){
+      const std::uint8_t* white = r.counts[WHITE*NUM_PIECES + name].data();
+      const std::uint8_t* black = r.counts[BLACK*NUM_PIECES + name].data();
+      const std::int32_t value = piece_values[name];
+      for(std::size_t i=begin; i<end; i++) out[i] += value * (std::int32_t(white[i]) - std::int32_t(black[i]));
+    }
+    const std::uint8_t* turn = batch.turn.data();
+    for(std::size_t i=begin; i<end; i++) out[i] *= turn[i]==WHITE ? 1 : -1;
+  }
+
+  using G = StandardGeometry;
+
+  // one ray of a piece as `ray_moves` walks it, the displacement as a mailbox offset
+  struct Ray{
+    int offset;
+    int max_steps;
+    Landing landing;
+  };
+
+  // the rays of every piece code, from `move_rule`
+  const std::vector<Ray>* piece_rays(){
+    static std::vector<Ray> rays[2 * NUM_PIECES];
+    static bool ready = [](){
+      for(int code=0; code<2*NUM_PIECES; code++){
+	const MoveRule & rule = move_rule(Name(code % NUM_PIECES), Color(code / NUM_PIECES));
+	Landing landing = rule.captures.empty() ? MOVE_OR_CAPTURE : MOVE_ONLY;
+	for(const Displacement & d: rule.rays) rays[code].push_back(Ray{G::offset(d), rule.max_steps, landing});
+	for(const Displacement & d: rule.captures) rays[code].push_back(Ray{G::offset(d), 1, CAPTURE_ONLY});
+      }
+      return true;
+    }();
+    (void)ready;
+    return rays;
+  }
+
+  // every square each piece code could reach from each square on an empty board, so that
+  // pieces nowhere near a king need not be walked
+  struct Reach{
+    G::Word squares[2 * NUM_PIECES][G::squares];
+    Reach(){
+      for(int code=0; code<2*NUM_PIECES; code++){
+	for(int square=0; square<G::squares; square++){
+	  G::Word out = 0;
+	  for(const Ray & ray: piece_rays()[code]){
+	    int cell = G::mailbox(G::pos(square));
+	    for(int step=0; step!=ray.max_steps; step++){
+	      cell += ray.offset;
+	      if(G::square_at[cell] < 0) break;
+	      out |= G::bit(G::square_at[cell]);
+	    }
+	  }
+	  squares[code][square] = out;
+	}
+      }
+    }
+  };
+
+  const Reach & reach(){
+    static const Reach table;
+    return table;
+  }
+
+  /*
+   * The squares the piece on `square` can move to, as its movement function finds them,
+   * on a board of piece codes plus one.
+   */
+  G::Word targets(const std::uint8_t* board, G::Word occupancy, int square){
+    const int code = board[square] - 1;
+    const int color = code / NUM_PIECES;
+    const bool first_rank = code % NUM_PIECES==PAWN && G::pos(square).first==pawn_start_row<G>(Color(color));
+    const int start = G::mailbox(G::pos(square));
+    G::Word out = 0;
+    for(const Ray & ray: piece_rays()[code]){
+      const int max_steps = ray.landing==MOVE_ONLY && first_rank ? 2 : ray.max_steps;
+      int cell = start;
+      for(int step=0; step!=max_steps; step++){
+	cell += ray.offset;
+	int to = G::square_at[cell];
+	if(to < 0) break;
+	if((occupancy & G::bit(to)) == 0){
+	  if(ray.landing==CAPTURE_ONLY) break;
+	  out |= G::bit(to);
+	  continue;
+	}
+	if((board[to] - 1) / NUM_PIECES != color && ray.landing!=MOVE_ONLY) out |= G::bit(to);
+	break;
+      }
+    }
+    return out;
+  }
+
+  // whether a piece of the other player can reach a king of `player`, as `safe_move` checks
+  bool attacked(const std::uint8_t* board, G::Word occupancy, int player){
+    const std::uint8_t king = player*NUM_PIECES + KING + 1;
+    G::Word kings = 0;
+    for(int square=0; square<G::squares; square++)
+      if(board[square]==king) kings |= G::bit(square);
+    if(kings==0) return false;
+    const Reach & far = reach();
+    for(int square=0; square<G::squares; square++){
+      if(board[square]==0 || (board[square] - 1) / NUM_PIECES == player) continue;
+      if((far.squares[board[square] - 1][square] & kings) == 0) continue;
+      if(targets(board, occupancy, square) & kings) return true;
+    }
+    return false;
+  }
+
+  // the moves of `player` that don't leave a king of theirs attacked, as `legal_moves` finds them
+  int count_legal_moves(std::uint8_t* board, G::Word occupancy, int player){
+    int count = 0;
+    for(int from=0; from<G::squares; from++){
+      if(board[from]==0 || (board[from] - 1) / NUM_PIECES != player) continue;
+      G::Word moves = targets(board, occupancy, from);
+      for(int to=0; to<G::squares; to++){
+	if((moves & G::bit(to)) == 0) continue;
+	std::uint8_t captured = board[to];
+	board[to] = board[from];
+	board[from] = 0;
+	count += !attacked(board, (occupancy | G::bit(to)) & ~G::bit(from), player);
+	board[from] = board[to];
+	board[to] = captured;
+      }
+    }
+    return count;
+  }
+
+  /*
+   * Counts legal moves and finds the status of positions [begin, end) on a mailbox of
+   * piece codes, applying the rules of `move_rule` without building games. Only positions
+   * without a legal move are built as games, to tell checkmate from a draw exactly as
+   * `in_checkmate` does.
+   */
+  void count_moves(const PositionBatch & batch, BatchResults & r, std::size_t begin, std::size_t end){
+    std::uint8_t board[G::squares];
+    for(std::size_t i=begin; i<end; i++){
+      G::Word occupancy = 0;
+      for(int square=0; square<G::squares; square++){
+	board[square] = batch.squares[square][i];
+	if(board[square]!=0) occupancy |= G::bit(square);
+      }
+      int player = batch.turn[i];
+      r.legal_moves[i] = count_legal_moves(board, occupancy, player);
+      if(r.legal_moves[i]==0){
+	ArenaScope scratch;
+	Game g = batch.game(i);
+	r.status[i] = has_possible_moves(g, other_color(g.get_turn())) ? STATUS_CHECKMATE : STATUS_DRAW;
+      }
+      else r.status[i] = attacked(board, occupancy, player) ? STATUS_CHECK : STATUS_PLAYING;
+    }
+  }
+
+  void evaluate_positions(const PositionBatch & batch, BatchResults & r, std::size_t begin, std::size_t end){
+    const std::uint8_t* squares[G::squares];
+    for(int square=0; square<G::squares; square++) squares[square] = batch.squares[square].data() + begin;
+    evaluate_batch(squares, batch.turn.data() + begin, end - begin, r.evaluation.data() + begin);
+  }
+}
+
+/**
+ * Adds the position of a game.
+ * @return its index in the batch
+ */
+std::size_t PositionBatch :: add(Game & g){
+  std::uint8_t codes[StandardGeometry::squares];
+  position_codes(g, codes);
+  return add(codes, g.get_turn());
+}
+
+/**
+ * Adds a packed position, without building a game for it.
+ * @return its index in the batch
+ */
+std::size_t PositionBatch :: add(const PackedPosition & p){
+  std::uint8_t codes[StandardGeometry::squares];
+  Color player = unpack_codes(p, codes);
+  return add(codes, player);
+}
+
+/**
+ * Adds a position given as `position_codes` writes it.
+ * @return its index in the batch
+ */
+std::size_t PositionBatch :: add(const std::uint8_t codes[StandardGeometry::squares], Color player){
+  for(int square=0; square<StandardGeometry::squares; square++) squares[square].push_back(codes[square]);
+  turn.push_back(player);
+  return turn.size() - 1;
+}
+
+void PositionBatch :: clear(){
+  for(auto& square: squares) square.clear();
+  turn.clear();
+}
+
+std::size_t PositionBatch :: size() const{
+  return turn.size();
+}
+
+/**
+ * @return position `index` as a game, built from the shared canonical pieces
+ */
+Game PositionBatch :: game(std::size_t index) const{
+  std::uint8_t codes[StandardGeometry::squares];
+  for(int square=0; square<StandardGeometry::squares; square++) codes[square] = squares[square][index];
+  return codes_game(codes, Color(turn[index]));
+}
+
+/**
+ * Analyses every position of a batch. Threads take chunks of positions in turn, so
+ * positions with many moves don't hold up the rest.
+ * @param batch the positions
+ * @param r the results, resized to the batch
+ * @param threads worker threads, zero for one per core
+ */
+void analyse_batch(const PositionBatch & batch, BatchResults & r, int threads){
+  std::size_t n = batch.size();
+  r.legal_moves.resize(n);
+  r.status.resize(n);
+  r.evaluation.resize(n);
+  r.material.resize(n);
+  for(auto& count: r.counts) count.resize(n);
+  if(threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<std::size_t>(threads, (n + BATCH_CHUNK - 1) / BATCH_CHUNK);
+
+  std::atomic<std::size_t> next{0};
+  auto worker = [&](){
+    for(std::size_t begin = next.fetch_add(BATCH_CHUNK); begin < n; begin = next.fetch_add(BATCH_CHUNK)){
+      std::size_t end = std::min(begin + BATCH_CHUNK, n);
+      count_pieces(batch, r, begin, end);
+      material(batch, r, begin, end);
+      count_moves(batch, r, begin, end);
+      evaluate_positions(batch, r, begin, end);
+    }
+  };
+  if(threads <= 1){
+    worker();
+    return;
+  }
+  std::vector<std::thread> workers;
+  for(int t=0; t<threads; t++) workers.emplace_back(worker);
+  for(std::thread& w: workers) w.join();
+}
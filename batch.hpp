@@ -0,0 +1,50 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "archive.hpp"
+#include "chess.hpp"
+
+/**
+ * Many positions stored square by square rather than position by position: `squares[s][i]`
+ * is the piece code plus one on square `s` of position `i`, zero when empty. Kernels that
+ * visit every square then read consecutive bytes of consecutive positions: piece counts
+ * are vectorised across positions and the evaluation adds network rows square by square
+ * across a block of positions. Moves are counted on the piece codes too, one position at
+ * a time, without building games.
+ */
+class PositionBatch{
+public:
+  std::size_t add(Game &);
+  std::size_t add(const PackedPosition &);
+  std::size_t add(const std::uint8_t codes[StandardGeometry::squares], Color);
+  void clear();
+  std::size_t size() const;
+  Game game(std::size_t index) const;
+
+  std::vector<std::uint8_t> squares[StandardGeometry::squares];
+  std::vector<std::uint8_t> turn;
+};
+
+enum BatchStatus {STATUS_PLAYING, STATUS_CHECK, STATUS_CHECKMATE, STATUS_DRAW};
+
+/**
+ * What `analyse_batch` finds out about every position of a batch, indexed like it.
+ * Checkmate and draw are as `in_checkmate` and `in_draw` decide them. Check means a king of
+ * the player to move is attacked, in the sense `safe_move` uses.
+ * Scores are from the point of view of the player to move: `evaluation` is the network's,
+ * `material` the difference in `piece_values`.
+ */
+struct BatchResults{
+  std::vector<std::uint16_t> legal_moves;
+  std::vector<std::uint8_t> status;
+  std::vector<std::int32_t> evaluation;
+  std::vector<std::int32_t> material;
+  // how many of each piece code every position has
+  std::vector<std::uint8_t> counts[2 * NUM_PIECES];
+};
+
+void analyse_batch(const PositionBatch &, BatchResults &, int threads = 0);
+
+#endif
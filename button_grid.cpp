@@ -7,8 +7,10 @@
 #include <QGridLayout>
 #include <QButtonGroup>
 #include "chess.hpp"
+#include "see.hpp"
 #include <functional>
 #include <string>     // std::string, std::to_string
+#include <cstdlib>
 char icons[2][10][4] = {{"♜","♞","♝","♛","♚","♟","♞","♟","♜"}, {"♖","♘","♗","♕","♔","♙","♘","♙","♖"}};
 
 void set_color(QPushButton* b, QColor c){
@@ -22,11 +24,11 @@ void set_color(QPushButton* b, QColor c){
 }
  
 using ButtonFN = std::function<void(QPushButton*, Pos)>;
-using Buttons = QPushButton*(*)[8];
+using Buttons = QPushButton*(*)[Board::cols];
 
 void button_map(Buttons buttons, ButtonFN fn){
-  for(int row=0; row<8;row++){
-    for(int col=0; col<8;++col){
+  for(int row=0; row<Board::rows;row++){
+    for(int col=0; col<Board::cols;++col){
       QPushButton* b = buttons[row][col];
       fn(b, Pos{row,col});
     }
@@ -34,8 +36,8 @@ void button_map(Buttons buttons, ButtonFN fn){
 }
 
 void show_pieces(Buttons buttons, Game g){
-  for(int row=0; row<8;row++){
-    for(int col=0; col<8;++col){
+  for(int row=0; row<Board::rows;row++){
+    for(int col=0; col<Board::cols;++col){
       QPushButton* b = buttons[row][col];
       Piece* piece= g.board.get_piece(Pos{row,col});
       auto txt = " ";
@@ -48,8 +50,8 @@ void show_pieces(Buttons buttons, Game g){
 }
 
 void checker_board(Buttons buttons){
-  for(int row=0; row<8;row++){
-    for(int col=0; col<8;++col){
+  for(int row=0; row<Board::rows;row++){
+    for(int col=0; col<Board::cols;++col){
       bool gray = (row+col) % 2 == 0;
       QColor c = gray ? QColor(Qt::gray):QColor(Qt::white);
       set_color(buttons[row][col], c);
@@ -58,13 +60,17 @@ void checker_board(Buttons buttons){
 }
 
 
-void show_set(Buttons buttons, MoveSet* s, Qt::GlobalColor color, Qt::GlobalColor dark){
-  for(const Pos& pos : *(s)){
-    QPushButton* b = buttons[pos.first][pos.second];
-    b->update();
-    auto final_color = (pos.first + pos.second) % 2 != 0 ? color : dark;
-    set_color(b, QColor(final_color));
-  }
+// how far below the best move, in centipawns, a move still counts as good or as playable
+const int GOOD_MOVE_MARGIN = 10;
+const int PLAYABLE_MOVE_MARGIN = 100;
+// more lines than any position has moves, so help mode ranks them all
+const int HELP_LINES = 256;
+
+void show_square(Buttons buttons, Pos pos, Qt::GlobalColor color, Qt::GlobalColor dark){
+  QPushButton* b = buttons[pos.first][pos.second];
+  b->update();
+  auto final_color = (pos.first + pos.second) % 2 != 0 ? color : dark;
+  set_color(b, QColor(final_color));
 }
 void ButtonGrid::render(){
   checker_board(buttons);
@@ -81,13 +87,31 @@ void ButtonGrid::render(){
   }
   else{
     if(model.get_help()){
-      MoveSet* s = all_moves(model.game,model.game.get_turn());
-      checker_board(buttons);
-      show_set(buttons, s, Qt::yellow, Qt::darkYellow);
-      delete s;
-      s = all_moves(model.game,other_color(model.game.get_turn()));
-      show_set(buttons, s, Qt::red, Qt::darkRed);
-      delete s;
+      // red: pieces of the player to move that are lost to an exchange, worked out once
+      // per position. The target squares of the player's moves as the search ranks them:
+      // green for the best and those as good, yellow for playable, magenta for the rest
+      if(threatened_key != model.game.key){
+	ArenaScope scratch;
+	MoveSet* s = winning_captures(model.game,other_color(model.game.get_turn()));
+	threatened.assign(s->begin(), s->end());
+	free_move_set(s);
+	threatened_key = model.game.key;
+      }
+      for(const Pos& pos : threatened) show_square(buttons, pos, Qt::red, Qt::darkRed);
+
+      std::vector<PvLine> lines;
+      {
+	std::lock_guard<std::mutex> guard(ranked_lock);
+	if(ranked_generation == ponder_generation) lines = ranked;
+      }
+      // worst first, so the best move onto a square decides its colour
+      for(auto line = lines.rbegin(); line != lines.rend(); ++line){
+	int loss = lines[0].score - line->score;
+	Pos to = line->pv[0].to;
+	if(loss <= GOOD_MOVE_MARGIN) show_square(buttons, to, Qt::green, Qt::darkGreen);
+	else if(loss <= PLAYABLE_MOVE_MARGIN) show_square(buttons, to, Qt::yellow, Qt::darkYellow);
+	else show_square(buttons, to, Qt::magenta, Qt::darkMagenta);
+      }
     }
   }
   auto player_1_string = QStringLiteral("Player 1: %1").arg(model.get_score(0));
@@ -102,11 +126,62 @@ void ButtonGrid::render(){
 
 
 
+/*
+ * Describes a search result from white's point of view, e.g. "depth 6  +0.35  e2e4 e7e5".
+ */
+QString describe_analysis(const SearchInfo& info, Color turn){
+  int score = turn==WHITE ? info.score : -info.score;
+  QString value;
+  if(std::abs(score) >= MATE_SCORE - MAX_PLY){
+    int moves = (MATE_SCORE - std::abs(score) + 1) / 2;
+    value = QStringLiteral("%1mate %2").arg(score > 0 ? "+" : "-").arg(moves);
+  }
+  else value = QString::asprintf("%+.2f", score / 100.0);
+  QString line;
+  for(const Move& m: info.pv) line += QString::fromStdString(move_name(m)) + " ";
+  return QStringLiteral("depth %1  %2  %3").arg(info.depth).arg(value).arg(line.trimmed());
+}
+
+/*
+ * Starts searching the current position in the background, ranking every move when help
+ * is on. Results from an earlier position that are still queued are recognised by their
+ * generation and dropped.
+ */
+void ButtonGrid::ponder(){
+  int generation = ++ponder_generation;
+  Color turn = model.game.get_turn();
+  analysis->setText("");
+  SearchLimits limits;
+  if(model.get_help()) limits.multi_pv = HELP_LINES;
+  {
+    std::lock_guard<std::mutex> guard(ranked_lock);
+    ranked_generation = generation;
+    ranked.clear();
+  }
+  ponderer->start(model.game, [this, generation, turn](const SearchInfo& info){
+    {
+      std::lock_guard<std::mutex> guard(ranked_lock);
+      if(ranked_generation == generation) ranked = info.lines;
+    }
+    emit analysis_changed(generation, describe_analysis(info, turn));
+  }, limits);
+}
+
+void ButtonGrid::show_analysis(int generation, QString text){
+  if(generation != ponder_generation) return;
+  analysis->setText(text);
+  // the move ranking in the help overlay deepens with the search
+  if(model.get_help()) render();
+}
+
+
 void ButtonGrid:: on_click(int i){
-  int col = i%8;
-  int row = i/8;
+  int col = i%Board::cols;
+  int row = i/Board::cols;
   Pos pos = Pos{row,col};
+  std::uint64_t before = model.game.key;
   model.update_game(pos);
+  if(model.game.key != before) ponder();
   show_pieces(buttons, model.game);
   // auto txt = " ";
   Piece* piece = model.game.board.get_piece(pos);
@@ -119,33 +194,51 @@ void ButtonGrid:: on_click(int i){
 }
 
 void ButtonGrid:: redo_slot(){
+  ponderer->stop();
   model.redo();
   show_pieces(buttons, model.game);
   render();
+  ponder();
+}
+
+void ButtonGrid:: line_slot(){
+  ponderer->stop();
+  model.next_line();
+  show_pieces(buttons, model.game);
+  render();
+  ponder();
 }
 
 void ButtonGrid:: undo_slot(){
+  ponderer->stop();
   model.undo();
   show_pieces(buttons, model.game);
   render();
+  ponder();
 }
 
 void ButtonGrid:: reset_slot(){
+  ponderer->stop();
   model.reset();
   show_pieces(buttons, model.game);
   render();
+  ponder();
 }
 
 void ButtonGrid:: resign_slot(){
+  ponderer->stop();
   model.resign();
   show_pieces(buttons, model.game);
   render();
+  ponder();
 }
 
 void ButtonGrid:: fairy_slot(){
+  ponderer->stop();
   model.fairy();
   show_pieces(buttons, model.game);
   render();
+  ponder();
 }
 
 ButtonGrid::  ButtonGrid(int rs, int cs):
@@ -159,19 +252,28 @@ ButtonGrid::  ButtonGrid(int rs, int cs):
   , resign {new QPushButton{"Resign"}}
   , undo {new QPushButton{"Undo"}}
   , redo  {new QPushButton{"Redo"}}
+  , line  {new QPushButton{"Line"}}
   , fairy  {new QPushButton{"Fairy"}}
   , scores_layout {new QHBoxLayout}
   , player_1_score {new QLabel("Player 1:0")}
   , player_2_score {new QLabel("Player 2:0")}
+  , analysis {new QLabel("")}
   , main_layout {new QVBoxLayout}
   , model{}
+  , ponderer{new Ponderer}
+  , ponder_generation{0}
+  , ranked_lock{}
+  , ranked_generation{0}
+  , ranked{}
+  , threatened_key{0}
+  , threatened{}
 {
     
   layout->setSpacing(0.1);
   for(int row=0; row<num_rows; ++row){
     for(int col=0; col<num_cols; ++col){
       auto *b = new QPushButton(" ");
-      button_group->addButton(b,row*8+col);
+      button_group->addButton(b,row*Board::cols+col);
       b->setStyleSheet("font-size: 60px;");
       b->setFlat(true);
       layout->addWidget(b,row,col,1,1);
@@ -183,15 +285,19 @@ ButtonGrid::  ButtonGrid(int rs, int cs):
   connect(button_group, SIGNAL(buttonReleased(int)), this, SLOT(on_click(int)));
   connect(undo, SIGNAL(released()), this, SLOT(undo_slot()));
   connect(redo, SIGNAL(released()), this, SLOT(redo_slot()));
+  connect(line, SIGNAL(released()), this, SLOT(line_slot()));
   connect(fairy, SIGNAL(released()), this, SLOT(fairy_slot()));
   connect(reset, SIGNAL(released()), this, SLOT(reset_slot()));
   connect(resign, SIGNAL(released()), this, SLOT(resign_slot()));
+  connect(this, SIGNAL(analysis_changed(int, QString)),
+	  this, SLOT(show_analysis(int, QString)), Qt::QueuedConnection);
 
 
   option_button_layout->addWidget(reset);
   option_button_layout->addWidget(resign);
   option_button_layout->addWidget(undo);
   option_button_layout->addWidget(redo);
+  option_button_layout->addWidget(line);
   option_button_layout->addWidget(fairy);
   auto l = QStringLiteral("Player 2: %1").arg(1);
   auto l2 = QStringLiteral("Player 1: %1").arg(8);
@@ -200,10 +306,16 @@ ButtonGrid::  ButtonGrid(int rs, int cs):
   player_2_score = new QLabel(l2);
   scores_layout->addWidget(player_1_score);
   scores_layout->addWidget(player_2_score);
+  scores_layout->addWidget(analysis);
     
   main_layout->addLayout(layout);
   main_layout->addLayout(option_button_layout);
   main_layout->addLayout(scores_layout);
 
   render();
+  ponder();
 };
+
+ButtonGrid:: ~ButtonGrid(){
+  delete ponderer;
+}
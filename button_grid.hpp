@@ -6,7 +6,10 @@
 #include <QPushButton>
 #include <QButtonGroup>
 #include <QLabel> 
+#include <mutex>
+#include <vector>
 #include "chess.hpp"
+#include "ponder.hpp"
 class ButtonGrid : public QObject
 {
   Q_OBJECT
@@ -15,17 +18,23 @@ private slots:
   void on_click(int i);
   void undo_slot();
   void redo_slot();
+  void line_slot();
   void resign_slot();
   void reset_slot();
   void fairy_slot();
-  
+  void show_analysis(int generation, QString text);
+
+signals:
+  void analysis_changed(int generation, QString text);
+
 public:
   const int num_rows;
   const int num_cols;
   QGridLayout* layout;
   // std::vector<std::vector<QPushButton*>> *buttons;
-  QPushButton* buttons[8][8];
+  QPushButton* buttons[Board::rows][Board::cols];
   explicit ButtonGrid(int rs, int cs);
+  ~ButtonGrid();
   QButtonGroup* button_group;
 
   QHBoxLayout *option_button_layout;
@@ -33,15 +42,27 @@ public:
   QPushButton *resign ;
   QPushButton *undo ;
   QPushButton *redo ;
+  QPushButton *line ;
   QPushButton *fairy ;
   QHBoxLayout *scores_layout;
   QLabel* player_1_score;
   QLabel* player_2_score;
+  QLabel* analysis;
   QVBoxLayout *main_layout;
   
 private:
   Model model;
+  Ponderer* ponderer;
+  int ponder_generation;
+  // the ranked moves of the latest search, written on the search thread
+  std::mutex ranked_lock;
+  int ranked_generation;
+  std::vector<PvLine> ranked;
+  // the help overlay's threatened pieces, for the position with this key
+  std::uint64_t threatened_key;
+  std::vector<Pos> threatened;
   void render();
+  void ponder();
   
 };
 
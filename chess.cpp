@@ -1,6 +1,7 @@
 #include "chess.hpp"
+#include "log.hpp"
+#include "nnue.hpp"
 #include <unordered_map>
-#include <iostream>
 /*
 
 From https://stackoverflow.com/questions/15160889/how-to-make-unordered-set-of-pairs-of-integers-in-c
@@ -34,11 +35,6 @@ std::vector<Displacement> Ls = {Displacement(1,2),
 				Displacement(-2,1),
 				Displacement(-2,-1)};
 
-PieceType :: PieceType(Name n, Movement m):
-  name{n}
-  , black_movement{m}
-  , white_movement{m}
-{};
 
 /**
  * A function to return whether an integer is within a range.
@@ -52,52 +48,152 @@ bool in_range(int x, int lower=0, int upper=7){
 }
 
 
+
 /**
- * A function to return whether a position is in the board.
- * @param p the position we want to check
- * @return whether the position is on the board
+ * A function to flip Color between black and white
+ * @param c the color to be flipped
+ * @return the flipped color
  */
-bool Board::valid_pos(Pos p){
-  return in_range(p.first) && in_range(p.second);
+Color other_color(Color c){
+  return c == BLACK ? WHITE : BLACK;
 }
 
 
 /**
- * A function to move the piece at Pos start, to the Pos end
- * @param start the position of the piece that should be moved
- * @param end the position the piece shoudl be moved too
+ * Makes an empty MoveSet. Inside an `ArenaScope` both the set and its nodes live in the
+ * thread's arena, otherwise they come from the heap.
+ * @return the new set, to be released with `free_move_set`
  */
-void Board::move_piece(Pos start, Pos end){
-  if(!valid_pos(start) || !valid_pos((end))) return;
-  Piece* p1 = board[start.first][start.second];
-  if(p1!=nullptr){
-    board[end.first][end.second] = board[start.first][start.second];
-    board[start.first][start.second] = nullptr;
+MoveSet* make_move_set(){
+  return arena_new<MoveSet>();
+}
+
+/**
+ * Releases a MoveSet made by `make_move_set` or returned by a movement function.
+ * @param s the set to release, may be nullptr
+ */
+void free_move_set(MoveSet* s){
+  if(s==nullptr) return;
+  arena_delete(s, s->get_allocator().arena != nullptr);
+}
+
+
+const int piece_values[NUM_PIECES] = {500, 300, 300, 900, 10000, 100, 450, 400, 400};
+
+namespace {
+  // One key per piece code and square of a geometry, numbered like `Geometry::index`
+  template <class G>
+  struct ZobristKeys{
+    std::uint64_t squares[2*NUM_PIECES][G::squares];
+    std::uint64_t black_to_move;
+    ZobristKeys(){
+      // splitmix64, so the keys are the same on every run
+      std::uint64_t state = 0x9E3779B97F4A7C15ull;
+      auto next = [&state](){
+	std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+      };
+      for(auto& piece: squares)
+	for(auto& key: piece) key = next();
+      black_to_move = next();
+    }
+  };
+
+  template <class G>
+  const ZobristKeys<G> zobrist;
+
+  template <class G>
+  std::uint64_t square_key(const BasicPiece<G>* piece, Pos p){
+    return zobrist<G>.squares[piece_code(piece)][G::index(p)];
   }
 }
 
 /**
- * Returns the Piece* at a specified location.
- * @param p the position we query for a piece, a pair of ints of the form <x,y>
- * @return the piece at the position
+ * Computes the Zobrist key of a game from scratch.
+ * @param g the game
+ * @return a hash of the board and the player to move
  */
-Piece* Board::get_piece(Pos p){
-  return board[p.first][p.second];
+template <class G>
+std::uint64_t zobrist_key(BasicGame<G> & g){
+  std::uint64_t key = g.get_turn()==BLACK ? zobrist<G>.black_to_move : 0;
+  for(int square=0; square<G::squares; square++){
+    BasicPiece<G>* piece = g.board.at(square);
+    if(piece!=nullptr) key ^= square_key(piece, G::pos(square));
+  }
+  return key;
 }
 
+template <class G>
+BasicGame<G>::BasicGame(bool fairy): board{fairy}, accumulator{}, key{0}, move{WHITE} {
+  if constexpr (evaluated) accumulator_refresh(accumulator, board);
+  key = zobrist_key(*this);
+};
 /**
- * A function to flip Color between black and white
- * @param c the color to be flipped
- * @return the flipped color
+ * Makes a game from a position, for example one read back from storage.
+ * @param b the board
+ * @param turn the player to move
  */
-Color other_color(Color c){
-  return c == BLACK ? WHITE : BLACK;
+template <class G>
+BasicGame<G>::BasicGame(BasicBoard<G> b, Color turn): board{b}, accumulator{}, key{0}, move{turn} {
+  if constexpr (evaluated) accumulator_refresh(accumulator, board);
+  key = zobrist_key(*this);
+};
+template <class G>
+Color BasicGame<G>::get_turn(){return move;}
+template <class G>
+void BasicGame<G>::end_turn(){
+  move = other_color(move);
+  key ^= zobrist<G>.black_to_move;
 }
 
+/**
+ * Moves a piece and ends the turn, updating the evaluation accumulator for the
+ * squares that changed. The move is not checked for legality.
+ * @param from the position of the piece being moved
+ * @param to the position it moves to
+ * @return what `unmake_move` needs to restore the game
+ */
+template <class G>
+BasicUndo<G> BasicGame<G>::make_move(Pos from, Pos to){
+  BasicPiece<G>* moving = board.get_piece(from);
+  BasicPiece<G>* captured = board.get_piece(to);
+  if(captured!=nullptr){
+    if constexpr (evaluated) accumulator_remove(accumulator, captured, to);
+    key ^= square_key(captured, to);
+  }
+  if constexpr (evaluated){
+    accumulator_remove(accumulator, moving, from);
+    accumulator_add(accumulator, moving, to);
+  }
+  key ^= square_key(moving, from) ^ square_key(moving, to);
+  board.set_piece(to, moving);
+  board.set_piece(from, nullptr);
+  end_turn();
+  return BasicUndo<G>{from, to, captured};
+}
 
-Game::Game(bool fairy): board{fairy}, move{WHITE} {};
-Color Game::get_turn(){return move;}
-void Game::end_turn(){move = other_color(move);}
+/**
+ * Takes back a move made by `make_move`.
+ * @param u the record returned by the matching `make_move`
+ */
+template <class G>
+void BasicGame<G>::unmake_move(const BasicUndo<G> & u){
+  end_turn();
+  BasicPiece<G>* moving = board.get_piece(u.to);
+  if constexpr (evaluated){
+    accumulator_remove(accumulator, moving, u.to);
+    accumulator_add(accumulator, moving, u.from);
+  }
+  key ^= square_key(moving, u.to) ^ square_key(moving, u.from);
+  if(u.captured!=nullptr){
+    if constexpr (evaluated) accumulator_add(accumulator, u.captured, u.to);
+    key ^= square_key(u.captured, u.to);
+  }
+  board.set_piece(u.from, moving);
+  board.set_piece(u.to, u.captured);
+}
 
 /**
  * A function to return all positions a player of given color can move pieces to.
@@ -105,19 +201,17 @@ void Game::end_turn(){move = other_color(move);}
  * @param c the color of the player of interest
  * @return a set of all positions the player of color c can move pieces too
  */
-MoveSet* all_moves(Game g, Color c){
-  MoveSet* all_move_set = new MoveSet;
+template <class G>
+MoveSet* all_moves(BasicGame<G> g, Color c){
+  MoveSet* all_move_set = make_move_set();
   bool flipping = c!=g.get_turn();
   if(flipping) g.end_turn();
-  for(int i = 0; i < 8; ++i){
-    for(int j = 0; j < 8; ++j){
-      Pos pos {i,j};
-      Piece* piece = g.board.get_piece(pos);
-      if(piece!=nullptr && piece->color==c){
-	MoveSet* moves = piece->possible_moves(g, pos);
-	all_move_set->insert(moves->begin(), moves->end());
-	delete moves;
-      }
+  for(int square=0; square<G::squares; square++){
+    BasicPiece<G>* piece = g.board.at(square);
+    if(piece!=nullptr && piece->color==c){
+      MoveSet* moves = piece->possible_moves(g, G::pos(square));
+      all_move_set->insert(moves->begin(), moves->end());
+      free_move_set(moves);
     }
   }
   if(flipping) g.end_turn();
@@ -132,14 +226,16 @@ MoveSet* all_moves(Game g, Color c){
  * @param p1 the position of piece to be moved
  * @param p2 the position to be moved too
  */
-bool safe_move(Game g, Pos p1, Pos p2){
+template <class G>
+bool safe_move(BasicGame<G> g, Pos p1, Pos p2){
+  ArenaScope scratch;
   Color player = g.get_turn();
   Color opponent = other_color(player);
   g.board.move_piece(p1, p2);
   MoveSet* opponent_moves = all_moves(g, opponent);
   
   for(auto pos = opponent_moves->begin(); pos != opponent_moves->end(); ++pos){
-    Piece* piece = g.board.get_piece(*pos);
+    BasicPiece<G>* piece = g.board.get_piece(*pos);
     if(piece!=nullptr && piece->color==player && piece->name==KING){
       return false;
     }
@@ -154,16 +250,16 @@ bool safe_move(Game g, Pos p1, Pos p2){
  * @param c the color being tested
  * @return whether c has any legal/safe moves
  */
-bool has_possible_moves(Game g, Color c){
-  for(int i=0; i<8;i++){
-    for(int j=0;j<8;j++){
-      Pos pos = Pos{i,j};
-      Piece* piece = g.board.get_piece(pos);
-      if(piece!=nullptr && piece->color==c){
-	MoveSet* moves = piece->possible_moves(g, pos);
-	for(auto pos2 = moves->begin(); pos2 != moves->end(); ++pos2){
-	  if(safe_move(g, pos,*pos2)) return true;
-	}
+template <class G>
+bool has_possible_moves(BasicGame<G> g, Color c){
+  ArenaScope scratch;
+  for(int square=0; square<G::squares; square++){
+    Pos pos = G::pos(square);
+    BasicPiece<G>* piece = g.board.at(square);
+    if(piece!=nullptr && piece->color==c){
+      MoveSet* moves = piece->possible_moves(g, pos);
+      for(auto pos2 = moves->begin(); pos2 != moves->end(); ++pos2){
+	if(safe_move(g, pos,*pos2)) return true;
       }
     }
   }
@@ -171,12 +267,80 @@ bool has_possible_moves(Game g, Color c){
 }
 
 
+/**
+ * Lists every legal move of the player whose turn it is.
+ * @param g the current game
+ * @param out the list the moves are appended to
+ */
+template <class G>
+void legal_moves(BasicGame<G> g, MoveList & out){
+  Color c = g.get_turn();
+  for(int square=0; square<G::squares; square++){
+    Pos pos = G::pos(square);
+    BasicPiece<G>* piece = g.board.at(square);
+    if(piece==nullptr || piece->color!=c) continue;
+    MoveSet* moves = piece->possible_moves(g, pos);
+    for(const Pos& to: *moves){
+      if(safe_move(g, pos, to)) out.push_back(Move{pos, to});
+    }
+    free_move_set(moves);
+  }
+}
+
+/**
+ * Checks a move the way `Model::update_game` does: the player to move must own the piece,
+ * the piece must be able to reach the square and the move must not leave the king in check.
+ * @param g the current game
+ * @param from the position of the piece to move
+ * @param to the position to move it to
+ * @return whether the move may be played
+ */
+template <class G>
+bool legal_move(BasicGame<G> g, Pos from, Pos to){
+  if(!g.board.valid_pos(from) || !g.board.valid_pos(to) || from==to) return false;
+  BasicPiece<G>* piece = g.board.get_piece(from);
+  if(piece==nullptr || piece->color!=g.get_turn()) return false;
+  ArenaScope scratch;
+  MoveSet* moves = piece->possible_moves(g, from);
+  return moves->find(to)!=moves->end() && safe_move(g, from, to);
+}
+
+/**
+ * Names a square the usual way, files a-h from the left and ranks 1-8 from white's side.
+ * @param p the square
+ * @return a name such as "e4"
+ */
+std::string square_name(Pos p){
+  return std::string{char('a' + p.second), char('1' + p.first)};
+}
+
+/**
+ * @param m a move
+ * @return the move as its two squares, such as "e2e4"
+ */
+std::string move_name(Move m){
+  return square_name(m.from) + square_name(m.to);
+}
+
+/**
+ * Reads a square name written by `square_name`.
+ * @param name a name such as "e4"
+ * @return the square, or `invalid` if the name is not one
+ */
+Pos parse_square(const std::string & name){
+  if(name.size()!=2) return invalid;
+  Pos p {name[1] - '1', name[0] - 'a'};
+  return Board::geometry::contains(p) ? p : invalid;
+}
+
+
 /**
  * A function to return whether the current player has any moves
  * @param g the current game
  * @return whether the current current player is in checkmate
  */
-bool in_checkmate(Game g){
+template <class G>
+bool in_checkmate(BasicGame<G> g){
   Color c = g.get_turn();
   return !has_possible_moves(g, c) && has_possible_moves(g, other_color(c));
 }
@@ -186,35 +350,46 @@ bool in_checkmate(Game g){
  * @param g the current game
  * @return whether the game is in a draw
  */
-bool in_draw(Game g){
+template <class G>
+bool in_draw(BasicGame<G> g){
   Color c = g.get_turn();
   return !has_possible_moves(g, c) && !has_possible_moves(g, other_color(c));
 }
 
+/**
+ * A constructor for PieceTypes where both black/white have the same movement
+ * @param n name of the piece
+ * @param m A movement function for the piece
+ */
+template <class G>
+BasicPieceType<G> :: BasicPieceType(Name n, BasicMovement<G> m):
+  name{n}
+  , black_movement{m}
+  , white_movement{m}
+{};
+
 /**
  * A constructor for PieceTypes with different white/black movements
  * @param n name of the piece
  * @param wm A movement function for the white player
  * @param bm A movement function for the black player
  */
-PieceType :: PieceType(Name n, Movement wm, Movement bm):
+template <class G>
+BasicPieceType<G> :: BasicPieceType(Name n, BasicMovement<G> wm, BasicMovement<G> bm):
   name{n}, black_movement{bm}, white_movement{wm} {};
 
-/**
- * A constructor for PieceTypes where both black/white have the same movement
- * @param n name of the piece
- * @param m A movement function for the piece
- */
-Piece :: Piece(Name n, Color c, Movement& m):
+template <class G>
+BasicPiece<G> :: BasicPiece(Name n, Color c, BasicMovement<G>& m):
   name{n}, color{c}, possible_moves{m} {};
 
 /**
  * A member function for PieceTypes which makes a Piece of a given color
  * @param c color of the piece to be created
  */
-Piece* PieceType :: create(Color c){
-  Movement m = c== WHITE ? white_movement : black_movement;
-  return new Piece(name, c, m);
+template <class G>
+BasicPiece<G>* BasicPieceType<G> :: create(Color c){
+  BasicMovement<G> m = c== WHITE ? white_movement : black_movement;
+  return new BasicPiece<G>(name, c, m);
 }
 
 /**
@@ -222,8 +397,9 @@ Piece* PieceType :: create(Color c){
  * @param g a game
  * @param pos the position being tested
  */
-bool pos_has_piece(Game g, Pos pos){
-  return g.board.get_piece(pos)!=nullptr;
+template <class G>
+bool pos_has_piece(BasicGame<G> g, Pos pos){
+  return g.board.occupied(pos);
 }
 
 /**
@@ -231,7 +407,8 @@ bool pos_has_piece(Game g, Pos pos){
  * @param g a game
  * @param pos the position being tested
  */
-bool pos_is_empty(Game g, Pos pos){
+template <class G>
+bool pos_is_empty(BasicGame<G> g, Pos pos){
   return !pos_has_piece(g,pos);
 }
 
@@ -241,9 +418,10 @@ bool pos_is_empty(Game g, Pos pos){
  * @param g a game
  * @param pos the position being tested
  */
-bool capture_piece(Game g, Pos end){
+template <class G>
+bool capture_piece(BasicGame<G> g, Pos end){
   Color turn = g.get_turn();
-  Piece* piece = g.board.get_piece(end);
+  BasicPiece<G>* piece = g.board.get_piece(end);
   return (piece!=nullptr) && piece->color ==turn;
 }
 
@@ -254,9 +432,10 @@ bool capture_piece(Game g, Pos end){
  * @param max_steps the number of times the displacement can be reapplied, by default its -1.
     With negative values, it will displace till it reaches end of the board.
  */
-MoveSet* move_direction(Game g, Pos p, std::vector<Displacement> ds, int max_steps,
-			StopCondition should_stop){
-  MoveSet* s = new MoveSet;
+template <class G>
+MoveSet* move_direction(BasicGame<G> g, Pos p, const std::vector<Displacement> & ds, int max_steps,
+			BasicStopCondition<G> should_stop){
+  MoveSet* s = make_move_set();
   auto [original_x, original_y] = p;
   for(Displacement d:ds){
     Pos moving_to {original_x, original_y};
@@ -265,7 +444,7 @@ MoveSet* move_direction(Game g, Pos p, std::vector<Displacement> ds, int max_ste
       auto [x, y] = moving_to;
       moving_to = Pos{x+dx, y+dy};
       if(!g.board.valid_pos(moving_to))	break;
-      Piece* piece = g.board.get_piece(moving_to);
+      BasicPiece<G>* piece = g.board.get_piece(moving_to);
       if((piece!=nullptr && piece->color==g.get_turn()) || should_stop(g, moving_to)){
       	break;
       }
@@ -281,96 +460,169 @@ MoveSet* move_direction(Game g, Pos p, std::vector<Displacement> ds, int max_ste
 }
 
 
-//https://stackoverflow.com/questions/21956119/add-stdpair-with-operator
-std::pair<int, int> operator +(const std::pair<int, int>& x, const std::pair<int, int>& y) {
-    return std::make_pair(x.first + y.first, x.second + y.second);
+/**
+ * @return how pieces of a kind and color move; the piece types of every board are made
+ * from these, as is the batch move counter in batch.cpp
+ */
+const MoveRule & move_rule(Name n, Color c){
+  // white plays from row 0, so its pawns, cowards and samurai go down the rows
+  static const MoveRule rules[2][NUM_PIECES] = {
+    {{STRAIGHT, -1, {}}, {Ls, 1, {}}, {DIAGONAL, -1, {}}, {ALL, -1, {}}, {ALL, 1, {}},
+     {{U}, 1, {UL, UR}}, {Ls, 2, {}}, {UPWARDS, -1, {}}, {UPWARDS, -1, {}}},
+    {{STRAIGHT, -1, {}}, {Ls, 1, {}}, {DIAGONAL, -1, {}}, {ALL, -1, {}}, {ALL, 1, {}},
+     {{D}, 1, {DL, DR}}, {Ls, 2, {}}, {DOWNWARDS, -1, {}}, {DOWNWARDS, -1, {}}},
+  };
+  return rules[c][n];
 }
 
 /*
- * Makes a function that gives pawn movement, given the start row and direction.
+ * Makes a function that gives pawn movement, given the start row and its rule.
 
  */
-auto pawn_movement(int start_row, Displacement direction){
-  return [start_row, direction](Game g, Pos p){
+template <class G>
+BasicMovement<G> pawn_movement(int start_row, const MoveRule & rule){
+  std::vector<Displacement> forward = rule.rays;
+  std::vector<Displacement> diagonals = rule.captures;
+  return [start_row, forward, diagonals](BasicGame<G> g, Pos p){
     int steps = p.first==start_row ? 2 : 1;
-    MoveSet* moves = move_direction(g, p, {direction}, steps, pos_has_piece);
-    MoveSet* attacks = move_direction(g, p, {direction+L, direction+R}, 1, pos_is_empty);
-    for(auto a: *attacks) moves->insert(a);
-    delete attacks;
+    MoveSet* moves = make_move_set();
+    ray_moves(g.board, g.get_turn(), p, forward, steps, MOVE_ONLY, moves);
+    ray_moves(g.board, g.get_turn(), p, diagonals, 1, CAPTURE_ONLY, moves);
     return moves;
   };
 }
 
-Movement white_pawn_movement = pawn_movement(1, D);
-Movement black_pawn_movement = pawn_movement(6, U);
-
-Movement directional_movement(std::vector<Displacement> disps, int max_steps){
-  return [disps, max_steps](Game g, Pos p){
-    return move_direction(g, p, disps, max_steps);
+template <class G>
+BasicMovement<G> directional_movement(std::vector<Displacement> disps, int max_steps){
+  return [disps, max_steps](BasicGame<G> g, Pos p){
+    MoveSet* moves = make_move_set();
+    ray_moves(g.board, g.get_turn(), p, disps, max_steps, MOVE_OR_CAPTURE, moves);
+    return moves;
   };
 }
 
-PieceType king = PieceType(KING, directional_movement(ALL, 1));
-PieceType queen = PieceType(QUEEN, directional_movement(ALL));
-PieceType rook = PieceType(ROOK, directional_movement(STRAIGHT));
-PieceType bishop = PieceType(BISHOP, directional_movement(DIAGONAL));
-PieceType knight = PieceType(KNIGHT, directional_movement(Ls, 1));
-PieceType pawn = PieceType(PAWN, white_pawn_movement, black_pawn_movement);
-// PieceType pawn = PieceType(PAWN, directional_movement(ALL, 8), black_pawn_movement);
-PieceType paladin = PieceType(PALADIN, directional_movement(Ls, 2));
-PieceType coward = PieceType(COWARD,
-			     directional_movement(DOWNWARDS),
-			     directional_movement(UPWARDS));
-PieceType samurai = PieceType(SAMURAI,
-			      directional_movement(DOWNWARDS),
-			      directional_movement(UPWARDS));
-
-using PieceMap = std::unordered_map<char,PieceType>;
-char icons_[2][8][4] = {{"♜","♞","♝","♛","♚","♟"},
-			{"♖","♘","♗","♕","♔","♙"}};
-
-void show_board(Board board){
-    for(int r=0;r<8;r++){
-      for(int c=0;c<8;c++){
-	Piece* piece = board.get_piece(Pos{r,c});
-	if(piece==nullptr){
-	  std::cout << " ";
-	}
-	else std::cout << icons_[piece->color][piece->name];
-      }
-      std::cout << "\n";
-    }}
-
-Board::Board(bool fairy){
-  PieceType fairy_pieces[] = {samurai, paladin, bishop, queen, king, bishop, paladin, samurai};
-  PieceType standard_pieces[] = {rook, knight, bishop, queen, king, bishop, knight, rook};
-  PieceType pieces[8] = fairy? fairy_pieces : standard_pieces;
-    for (int i=0;i<8;i++){
-      board[0][i]=pieces[i].create(WHITE);
-      board[7][i]=pieces[i].create(BLACK);
-      board[1][i]=pawn.create(WHITE);
-      board[6][i]=pawn.create(BLACK);
+template <class G>
+BasicMovement<G> rule_movement(Name n, Color c){
+  const MoveRule & rule = move_rule(n, c);
+  if(n==PAWN) return pawn_movement<G>(pawn_start_row<G>(c), rule);
+  return directional_movement<G>(rule.rays, rule.max_steps);
+}
+
+/**
+ * The piece types of a geometry, made the first time they are asked for.
+ * @param n the name of the piece
+ * @return the piece type, to create pieces of
+ */
+template <class G>
+BasicPieceType<G>& piece_type(Name n){
+  static std::vector<BasicPieceType<G>> types = [](){
+    std::vector<BasicPieceType<G>> made;
+    for(int name=0; name<NUM_PIECES; name++)
+      made.emplace_back(Name(name), rule_movement<G>(Name(name), WHITE), rule_movement<G>(Name(name), BLACK));
+    return made;
+  }();
+  return types[n];
+}
+
+/**
+ * Pieces with the same name and color behave the same, so positions rebuilt from
+ * storage share one Piece of each kind instead of creating new ones.
+ * @return the shared piece of a kind
+ */
+template <class G>
+BasicPiece<G>* canonical_piece(Name n, Color c){
+  static BasicPiece<G>* pieces[2][NUM_PIECES] = {};
+  static bool ready = [](){
+    for(int name=0; name<NUM_PIECES; name++){
+      pieces[BLACK][name] = piece_type<G>(Name(name)).create(BLACK);
+      pieces[WHITE][name] = piece_type<G>(Name(name)).create(WHITE);
     }
-    show_board(*this);
+    return true;
+  }();
+  (void)ready;
+  return pieces[c][n];
+}
+
+/**
+ * @return the letter a piece is written as in text: KQRBNP, D for the paladin, C for the
+ * coward and S for the samurai, upper case for white and lower case for black
+ */
+char piece_letter(Name n, Color c){
+  const char letters[NUM_PIECES + 1] = "RNBQKPDCS";
+  return c==WHITE ? letters[n] : letters[n] - 'A' + 'a';
 }
 
+/**
+ * Writes a position as one byte per square, the way positions are kept outside games by
+ * sessions and batches: the piece code plus one, zero when the square is empty.
+ * @param g the game
+ * @param codes a byte for every square, numbered like `Geometry::index`
+ */
+void position_codes(Game & g, std::uint8_t codes[StandardGeometry::squares]){
+  for(int square=0; square<StandardGeometry::squares; square++){
+    Piece* piece = g.board.at(square);
+    codes[square] = piece==nullptr ? 0 : piece_code(piece) + 1;
+  }
+}
+
+/**
+ * @param codes a position as `position_codes` writes it
+ * @param turn the player to move
+ * @return the position as a game, built from the shared canonical pieces
+ */
+Game codes_game(const std::uint8_t codes[StandardGeometry::squares], Color turn){
+  Board board = Board::empty();
+  for(int square=0; square<StandardGeometry::squares; square++){
+    if(codes[square]==0) continue;
+    int code = codes[square] - 1;
+    board.set_piece(StandardGeometry::pos(square), canonical_piece(Name(code % NUM_PIECES), Color(code / NUM_PIECES)));
+  }
+  return Game{board, turn};
+}
+
+// The rules for every board in geometry.hpp
+#define INSTANTIATE_RULES(G)						\
+  template class BasicPieceType<G>;					\
+  template class BasicPiece<G>;						\
+  template class BasicGame<G>;						\
+  template BasicPieceType<G>& piece_type<G>(Name);			\
+  template BasicPiece<G>* canonical_piece<G>(Name, Color);		\
+  template MoveSet* all_moves<G>(BasicGame<G>, Color);			\
+  template bool capture_piece<G>(BasicGame<G>, Pos);			\
+  template BasicMovement<G> directional_movement<G>(std::vector<Displacement>, int); \
+  template MoveSet* move_direction<G>(BasicGame<G>, Pos, const std::vector<Displacement> &, int, \
+				      BasicStopCondition<G>);		\
+  template bool has_possible_moves<G>(BasicGame<G>, Color);		\
+  template bool safe_move<G>(BasicGame<G>, Pos, Pos);			\
+  template bool in_checkmate<G>(BasicGame<G>);				\
+  template bool in_draw<G>(BasicGame<G>);				\
+  template bool legal_move<G>(BasicGame<G>, Pos, Pos);			\
+  template void legal_moves<G>(BasicGame<G>, MoveList &);		\
+  template std::uint64_t zobrist_key<G>(BasicGame<G> &);
+
+INSTANTIATE_RULES(StandardGeometry)
+INSTANTIATE_RULES(CapablancaGeometry)
+INSTANTIATE_RULES(GrandGeometry)
+
 Pos invalid{-1,-1};
 Model :: Model():
   game{}
   , selected{false}
   , selected_pos{invalid}
   , selected_moves{nullptr}
-  , undo_history{}
-  , redo_history{}
+  , history{}
   , scores{0}
   , help{false}
-{}
+{
+  history.reset(game);
+}
 
 
 void Model :: deselect_piece(){
   
   selected_pos = Pos{invalid};
-  delete (selected_moves);
+  free_move_set(selected_moves);
+  selected_moves = nullptr;
   selected=false;
 }
 
@@ -383,10 +635,9 @@ void Model :: select_piece(Pos pos, Piece* piece){
 }
 
 void Model :: move_selected_piece(Pos pos){
-  game.board.move_piece(selected_pos, pos);
+  history.play(game, Move{selected_pos, pos});
+  log_move(LOG_INFO, EVENT_MOVE, Move{selected_pos, pos}, game.key);
   deselect_piece();
-  show_board(game.board);
-  game.end_turn();
 }
 
 void Model :: update_game(Pos pos){
@@ -396,13 +647,7 @@ void Model :: update_game(Pos pos){
       deselect_piece();
       return;
     }
-    bool valid_move = !selected_moves->empty() &&
-      (selected_moves->find(pos)) != selected_moves->end();
-    bool safe_and_valid_move = valid_move && safe_move(game, selected_pos, pos);
-    if(safe_and_valid_move){
-      Game snapshot {game};
-      undo_history.push(snapshot);
-      redo_history = std::stack<Game>{};
+    if(legal_move(game, selected_pos, pos)){
       move_selected_piece(pos);
 
       if(in_checkmate(game)){
@@ -417,32 +662,37 @@ void Model :: update_game(Pos pos){
 }
 
 
-void Model :: stack_shift(std::stack<Game> & shift_from, std::stack<Game> & shift_to){
+void Model :: undo(){
   if(selected) deselect_piece();
-  if(!shift_from.empty()){
-    Game snapshot {shift_from.top()};
-    shift_to.push(game);
-    game = snapshot;
-    shift_from.pop();
-  }
+  if(history.undo(game)) log_position(LOG_INFO, EVENT_UNDO, game);
 }
 
-void Model :: undo(){
-  stack_shift(undo_history, redo_history);
+/**
+ * Replays the move taken back last, or after switching lines the next move of that line.
+ */
+void Model :: redo(){
+  if(selected) deselect_piece();
+  if(history.redo(game)) log_position(LOG_INFO, EVENT_REDO, game);
 }
 
-void Model :: redo(){
-  stack_shift(redo_history, undo_history);
+/**
+ * Goes to the next line branching off the current one, where it was left.
+ */
+void Model :: next_line(){
+  if(selected) deselect_piece();
+  if(history.next_line(game)) log_position(LOG_INFO, EVENT_LINE, game);
 }
 
 
 void Model :: reset(){
+  if(selected) deselect_piece();
   game = Game{};
-  undo_history = std::stack<Game>{};
-  redo_history = std::stack<Game>{};
+  history.reset(game);
+  log_position(LOG_INFO, EVENT_NEW_GAME, game);
 }
 
 void Model :: resign(){
+  log_position(LOG_INFO, EVENT_RESIGN, game);
   if(!in_checkmate(game))
   scores[other_color(game.get_turn())]+=1;
   reset();
@@ -457,13 +707,20 @@ bool Model :: get_help(){
   return help;
 }
 
+/**
+ * @return whether no move has been played yet. Once one has, going back to the start
+ * keeps every line, so starting a fairy game is left to a reset.
+ */
 bool Model :: is_new_game(){
-  return undo_history.empty();
+  return history.size()==1;
 }
 
 void Model :: fairy(){
-  if(undo_history.empty()){
+  if(is_new_game()){
+    if(selected) deselect_piece();
     game=Game{true};
+    history.reset(game);
+    log_position(LOG_INFO, EVENT_NEW_GAME, game);
   }
   else{
     help=!help;
@@ -5,16 +5,20 @@
 #include <unordered_set>
 #include <functional>
 #include <vector>
-#include <stack>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+#include "arena.hpp"
+#include "geometry.hpp"
 
 
-class Game;
+template <class G> class BasicGame;
 using Pos = std::pair<int,int>;
 using Displacement = std::pair<int, int>;
 // struct pair_hash;
 
 /**
- * A function to hash a pair<int,int>
+ * A function to hash a pair<int,int>. It is collision free for any board narrower than 64 files.
  * @param v a pair to hash.
  * @return A hash value
  */
@@ -34,75 +38,201 @@ struct PairEqual{
 };
 
 
-using MoveSet = std::unordered_set<Pos, pair_hash, PairEqual<int,int>>;
-using Movement = std::function<MoveSet*(Game, Pos)>;
+using MoveSet = std::unordered_set<Pos, pair_hash, PairEqual<int,int>, ArenaAllocator<Pos>>;
+
+/**
+ * The squares a piece can move to from a position, in a game on a board of geometry `G`.
+ */
+template <class G>
+using BasicMovement = std::function<MoveSet*(BasicGame<G>, Pos)>;
+using Movement = BasicMovement<StandardGeometry>;
+
+MoveSet* make_move_set();
+void free_move_set(MoveSet*);
 
 enum Name {ROOK, KNIGHT, BISHOP, QUEEN, KING, PAWN, PALADIN, COWARD, SAMURAI, NUM_PIECES};
 
 enum Color {BLACK, WHITE};
 enum GameState {NEW, MIDGAME, CHECKMATE};
 
+// Values in centipawns, indexed by Name. The king is priced so that no exchange trades it.
+extern const int piece_values[NUM_PIECES];
+
 
-MoveSet* all_moves(Game, Color);
+template <class G>
+MoveSet* all_moves(BasicGame<G>, Color);
 
 /**
  *  A piece class. Used to describe the movements, color and type of a speceific piece on the board.
-
+ *  Its movement is made for the board geometry `G`.
  */
-class Piece{
+template <class G>
+class BasicPiece{
 public:
-  Piece(Name, Color, Movement &);
+  BasicPiece(Name, Color, BasicMovement<G> &);
   const Name name;
   const Color color;
-  const Movement possible_moves;
+  const BasicMovement<G> possible_moves;
 };
 
+using Piece = BasicPiece<StandardGeometry>;
+
 
 /**
  * Used to generate pieces of the same type. For example, the types rook/queen will be instances of 
  * the PieceType class. This class can be used to generate specific `Pieces` of the PieceType.
  */
-class PieceType {
+template <class G>
+class BasicPieceType {
 public:
-  PieceType(Name, Movement);
-  PieceType(Name, Movement, Movement);
-  Piece* create(Color);
+  BasicPieceType(Name, BasicMovement<G>);
+  BasicPieceType(Name, BasicMovement<G>, BasicMovement<G>);
+  BasicPiece<G>* create(Color);
 private:
   Name name;
-  Movement black_movement;
-  Movement white_movement;
+  BasicMovement<G> black_movement;
+  BasicMovement<G> white_movement;
 };
 
+using PieceType = BasicPieceType<StandardGeometry>;
+
+template <class G>
+BasicPieceType<G>& piece_type(Name);
+
 /**
  * A class for the board, that helps track whether positions are valid positions on the board.
- * It also handles the movement of specific pieces.
+ * It also handles the movement of specific pieces. `G` is a `Geometry`, so the size of the
+ * board, its bounds checks and its ray tables are all fixed at compile time. Along with the
+ * pieces the board keeps an occupancy word with one bit per square.
  */
-class Board{
+template <class G>
+class BasicBoard{
 public:
-  Board(bool fairy=false);
-  Piece *get_piece(Pos);
+  using geometry = G;
+  static constexpr int rows = G::rows;
+  static constexpr int cols = G::cols;
+
+  BasicBoard(bool fairy=false);
+  static BasicBoard empty();
+  BasicPiece<G> *get_piece(Pos);
+  BasicPiece<G> *at(int square);
+  void set_piece(Pos, BasicPiece<G>*);
   void move_piece(Pos, Pos);
   bool valid_pos(Pos);
+  bool occupied(Pos) const;
+  typename G::Word occupancy() const;
 private:
-  Piece* board[8][8] {nullptr};
+  struct Empty{};
+  explicit BasicBoard(Empty) {}
+  BasicPiece<G>* board[G::squares] {nullptr};
+  typename G::Word occupied_squares {0};
 };
 
+// The board the game is played on
+using Board = BasicBoard<StandardGeometry>;
+
+
+/**
+ * The first layer of the evaluation network for one position. `Game` keeps it in step
+ * with its board through `make_move` and `unmake_move`; see nnue.hpp. The network is
+ * made for the standard board, so on other boards it stays zero.
+ */
+constexpr int ACCUMULATOR_SIZE = 32;
+struct Accumulator{
+  alignas(16) std::int16_t values[ACCUMULATOR_SIZE];
+};
+
+/**
+ * What `Game::make_move` needs to take a move back.
+ */
+template <class G>
+struct BasicUndo{
+  Pos from;
+  Pos to;
+  BasicPiece<G>* captured;
+};
+
+using Undo = BasicUndo<StandardGeometry>;
+
+struct Move{
+  Pos from;
+  Pos to;
+};
+
+using MoveList = std::vector<Move, ArenaAllocator<Move>>;
+
 
 /**
  * Used to keep track of the state of the current game.
- * It will track the turn, as well as store an internal `Board`.
+ * It will track the turn, as well as store an internal `BasicBoard<G>`. Games on other
+ * boards than the standard one follow the same rules, but have no evaluation.
  */
-class Game{
+template <class G>
+class BasicGame{
 public:
-  Game(bool fairy=false);
+  using geometry = G;
+  // whether the evaluation network, and so the accumulator, applies to this board
+  static constexpr bool evaluated = std::is_same<G, StandardGeometry>::value;
+
+  BasicGame(bool fairy=false);
+  BasicGame(BasicBoard<G>, Color);
   // Piece get_piece(std::pair<int,int>);
   Color get_turn();
   void end_turn();
-  Board board;
+  BasicUndo<G> make_move(Pos, Pos);
+  void unmake_move(const BasicUndo<G> &);
+  BasicBoard<G> board;
+  Accumulator accumulator;
+  // Zobrist key of the board and turn, kept up to date by `make_move` and `end_turn`
+  std::uint64_t key;
 private:
   Color move;
 };
 
+// The game on the standard board, which the engine, the GUI and the tools play
+using Game = BasicGame<StandardGeometry>;
+
+/**
+ * Every line played in a game, as a tree of moves. Lines share the moves they have in
+ * common, so a node costs a few dozen bytes whatever the size of the board. The tree
+ * has a current node, whose position the caller's `Game` is kept at; stepping to a
+ * neighbouring node makes or unmakes one move on it, and positions further away are
+ * rebuilt from the nearest stored copy, kept every `checkpoint_interval` plies.
+ *
+ * Playing a move that already leads from the current node follows it instead of
+ * starting a new line, and every node remembers which of its lines was visited last,
+ * which is where `redo` goes.
+ */
+class VariationTree{
+public:
+  static constexpr int checkpoint_interval = 16;
+  static constexpr std::uint32_t none = 0xffffffff;
+
+  VariationTree();
+  void reset(Game &);
+  void play(Game &, Move);
+  bool undo(Game &);
+  bool redo(Game &);
+  bool next_line(Game &);
+  void jump(Game &, std::uint32_t node);
+  bool at_root() const;
+  std::uint32_t current_node() const;
+  std::size_t size() const;
+private:
+  struct Node{
+    Move move;
+    Piece* captured;
+    std::uint32_t parent;
+    std::uint32_t first_child;
+    std::uint32_t next_sibling;
+    std::uint32_t last_visited;
+    std::uint32_t ply;
+  };
+  std::vector<Node> nodes;
+  std::unordered_map<std::uint32_t, Game> checkpoints;
+  std::uint32_t current;
+};
+
 class Model{
 public:
   Model();
@@ -117,6 +247,7 @@ public:
   void move_selected_piece(Pos);
   void undo();
   void redo();
+  void next_line();
   void resign();
   void reset();
   void fairy();
@@ -124,34 +255,234 @@ public:
   bool get_help();
   bool is_new_game();
 private:
-  void stack_shift(std::stack<Game> &, std::stack<Game> &);
-  std::stack<Game> undo_history;
-  std::stack<Game> redo_history;
+  VariationTree history;
   int scores[2];
   bool help;
 
 };
 
-using StopCondition = std::function<bool(Game, Pos)>;
+template <class G>
+using BasicStopCondition = std::function<bool(BasicGame<G>, Pos)>;
+using StopCondition = BasicStopCondition<StandardGeometry>;
+
+// Which squares a ray may end its moves on: the usual empty or enemy squares, only empty
+// squares (a pawn's push) or only enemy squares (a pawn's capture)
+enum Landing {MOVE_OR_CAPTURE, MOVE_ONLY, CAPTURE_ONLY};
+
+/**
+ * How a kind of piece moves, on any board: along every displacement in `rays`, repeated at
+ * most `max_steps` times or to the edge of the board when negative. A pawn only moves along
+ * `rays`, two steps from its starting rank, and only captures along `captures`; other
+ * pieces move or capture along `rays` and have no `captures`.
+ */
+struct MoveRule{
+  std::vector<Displacement> rays;
+  int max_steps;
+  std::vector<Displacement> captures;
+};
+
+const MoveRule & move_rule(Name, Color);
 
-bool capture_piece(Game, Pos);
-Movement directional_movement(std::vector<Displacement>, int max_steps = -1);
-MoveSet* move_direction(Game g, Pos p, std::vector<Displacement> ds, int max_steps,
-			StopCondition should_stop=capture_piece);
-bool has_possible_moves(Game g, Color c);
+/**
+ * @return the rank the pawns of a color start on, second from their side of the board
+ */
+template <class G>
+constexpr int pawn_start_row(Color c){
+  return c==WHITE ? 1 : G::rows - 2;
+}
+
+/*
+ * The rules below are templates over the board geometry. chess.cpp defines them and
+ * instantiates them for the geometries in geometry.hpp; a game on another board needs
+ * a line there too.
+ */
+template <class G>
+bool capture_piece(BasicGame<G>, Pos);
+template <class G>
+BasicMovement<G> directional_movement(std::vector<Displacement>, int max_steps = -1);
+template <class G>
+MoveSet* move_direction(BasicGame<G> g, Pos p, const std::vector<Displacement> & ds, int max_steps,
+			BasicStopCondition<G> should_stop=capture_piece<G>);
+template <class B>
+void ray_moves(B & board, Color turn, Pos p, const std::vector<Displacement> & ds, int max_steps,
+	       Landing landing, MoveSet* out);
+template <class G>
+bool has_possible_moves(BasicGame<G> g, Color c);
+template <class G>
+bool safe_move(BasicGame<G> g, Pos p1, Pos p2);
+template <class G>
+bool in_checkmate(BasicGame<G> g);
+template <class G>
+bool in_draw(BasicGame<G> g);
+template <class G>
+bool legal_move(BasicGame<G> g, Pos from, Pos to);
+template <class G>
+void legal_moves(BasicGame<G> g, MoveList & out);
+template <class G>
+std::uint64_t zobrist_key(BasicGame<G> & g);
+template <class G = StandardGeometry>
+BasicPiece<G>* canonical_piece(Name, Color);
+std::string square_name(Pos);
+std::string move_name(Move);
+Pos parse_square(const std::string &);
+char piece_letter(Name, Color);
+void position_codes(Game &, std::uint8_t codes[StandardGeometry::squares]);
+Game codes_game(const std::uint8_t codes[StandardGeometry::squares], Color turn);
 Color other_color(Color c);
 std::vector<Pos>* convert_set(MoveSet);
 
-// PieceType pawn = PieceType(PAWN, directional_movement(ALL));
-extern PieceType king;
-extern PieceType queen;
-extern PieceType rook;
-extern PieceType bishop;
-extern PieceType knight;
-extern PieceType pawn;
-extern PieceType paladin;
-extern PieceType coward;
-extern PieceType samurai;
+extern Pos invalid;
+
+/**
+ * @param piece a piece
+ * @return a number in [0, 2*NUM_PIECES) identifying the piece's color and name
+ */
+template <class G>
+inline int piece_code(const BasicPiece<G>* piece){
+  return piece->color*NUM_PIECES + piece->name;
+}
+
+
+/**
+ * Sets up the starting position. Boards wider than 8 files keep the usual back rank in the
+ * middle files and fill the outer files with rooks, or samurai in fairy chess.
+ * @param fairy whether to use the fairy back rank
+ */
+template <class G>
+BasicBoard<G>::BasicBoard(bool fairy){
+  static_assert(G::cols >= 8 && G::rows >= 4, "the starting position needs 8 files and 4 ranks");
+  Name fairy_pieces[] = {SAMURAI, PALADIN, BISHOP, QUEEN, KING, BISHOP, PALADIN, SAMURAI};
+  Name standard_pieces[] = {ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK};
+  Name* pieces = fairy? fairy_pieces : standard_pieces;
+  int first = (G::cols - 8) / 2;
+  for (int i=0;i<G::cols;i++){
+    BasicPieceType<G>& type = piece_type<G>(i>=first && i<first+8 ? pieces[i-first] : pieces[0]);
+    set_piece(Pos{0,i}, type.create(WHITE));
+    set_piece(Pos{G::rows-1,i}, type.create(BLACK));
+    set_piece(Pos{pawn_start_row<G>(WHITE),i}, piece_type<G>(PAWN).create(WHITE));
+    set_piece(Pos{pawn_start_row<G>(BLACK),i}, piece_type<G>(PAWN).create(BLACK));
+  }
+}
+
+/**
+ * @return a board with no pieces on it
+ */
+template <class G>
+BasicBoard<G> BasicBoard<G>::empty(){
+  return BasicBoard(Empty{});
+}
+
+/**
+ * Returns the Piece* at a specified location.
+ * @param p the position we query for a piece, a pair of ints of the form <x,y>
+ * @return the piece at the position
+ */
+template <class G>
+inline BasicPiece<G>* BasicBoard<G>::get_piece(Pos p){
+  return board[G::index(p)];
+}
+
+/**
+ * @param square a square index, see `Geometry::index`
+ * @return the piece on the square
+ */
+template <class G>
+inline BasicPiece<G>* BasicBoard<G>::at(int square){
+  return board[square];
+}
+
+/**
+ * Puts a piece (or nullptr) on a square, replacing whatever was there.
+ * @param p the position to change
+ * @param piece the piece to put there
+ */
+template <class G>
+inline void BasicBoard<G>::set_piece(Pos p, BasicPiece<G>* piece){
+  int square = G::index(p);
+  board[square] = piece;
+  if(piece!=nullptr) occupied_squares |= G::bit(square);
+  else occupied_squares &= ~G::bit(square);
+}
+
+/**
+ * A function to move the piece at Pos start, to the Pos end
+ * @param start the position of the piece that should be moved
+ * @param end the position the piece shoudl be moved too
+ */
+template <class G>
+void BasicBoard<G>::move_piece(Pos start, Pos end){
+  if(!valid_pos(start) || !valid_pos((end))) return;
+  BasicPiece<G>* p1 = get_piece(start);
+  if(p1!=nullptr){
+    set_piece(end, p1);
+    set_piece(start, nullptr);
+  }
+}
+
+/**
+ * A function to return whether a position is in the board.
+ * @param p the position we want to check
+ * @return whether the position is on the board
+ */
+template <class G>
+inline bool BasicBoard<G>::valid_pos(Pos p){
+  return G::contains(p);
+}
+
+/**
+ * @param p a position on the board
+ * @return whether there is a piece on it, from the occupancy word alone
+ */
+template <class G>
+inline bool BasicBoard<G>::occupied(Pos p) const{
+  return (occupied_squares & G::bit(G::index(p))) != 0;
+}
+
+/**
+ * @return a word with the bit of every occupied square set
+ */
+template <class G>
+inline typename G::Word BasicBoard<G>::occupancy() const{
+  return occupied_squares;
+}
+
+/**
+ * Adds the squares a piece reaches by repeating each displacement in ds, stopping at the
+ * edge of the board and at the first piece. The walk runs on the geometry's padded mailbox,
+ * so leaving the board is a single table lookup; displacements may be at most two squares
+ * in each direction.
+ * @param board the board to walk on
+ * @param turn the color of the moving piece
+ * @param p the position of the moving piece
+ * @param ds the displacements
+ * @param max_steps how often each displacement may be repeated, negative for no limit
+ * @param landing which squares the moves may end on
+ * @param out the set the squares are added to
+ */
+template <class B>
+void ray_moves(B & board, Color turn, Pos p, const std::vector<Displacement> & ds, int max_steps,
+	       Landing landing, MoveSet* out){
+  using G = typename B::geometry;
+  const int start = G::mailbox(p);
+  const auto occupancy = board.occupancy();
+  for(const Displacement& d: ds){
+    const int offset = G::offset(d);
+    int cell = start;
+    for(int step=0; step!=max_steps; step++){
+      cell += offset;
+      int square = G::square_at[cell];
+      if(square < 0) break;
+      if((occupancy & G::bit(square)) == 0){
+	if(landing==CAPTURE_ONLY) break;
+	out->insert(G::pos(square));
+	continue;
+      }
+      auto* piece = board.at(square);
+      if(piece->color!=turn && landing!=MOVE_ONLY) out->insert(G::pos(square));
+      break;
+    }
+  }
+}
 
 
 #endif
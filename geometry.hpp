@@ -0,0 +1,68 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Compile time description of a board with `Rows` ranks and `Cols` files.
+ *
+ * Squares are numbered row by row. Ray walks use a mailbox with a border of `pad` off-board
+ * cells on every side, so a step of up to two squares in any direction from a real square
+ * lands either on another real square or on the border, and a walk stops on the first
+ * border cell instead of range checking both coordinates. Occupancy fits in one machine
+ * word on boards of up to 64 squares and in a 128 bit word up to 128 squares.
+ */
+template <int Rows, int Cols>
+struct Geometry{
+  static_assert(Rows > 0 && Cols > 0, "a board needs squares");
+  static_assert(Rows * Cols <= 128, "occupancy must fit in 128 bits");
+
+  static constexpr int rows = Rows;
+  static constexpr int cols = Cols;
+  static constexpr int squares = Rows * Cols;
+  static constexpr int pad = 2;
+  static constexpr int stride = Cols + 2 * pad;
+  static constexpr int mailbox_size = (Rows + 2 * pad) * stride;
+
+  using Word = typename std::conditional<(squares <= 64), std::uint64_t, unsigned __int128>::type;
+
+  static constexpr bool contains(std::pair<int,int> p){
+    return static_cast<unsigned>(p.first) < static_cast<unsigned>(Rows)
+      && static_cast<unsigned>(p.second) < static_cast<unsigned>(Cols);
+  }
+  static constexpr int index(std::pair<int,int> p){
+    return p.first * Cols + p.second;
+  }
+  static constexpr std::pair<int,int> pos(int square){
+    return std::pair<int,int>{square / Cols, square % Cols};
+  }
+  static constexpr Word bit(int square){
+    return Word{1} << square;
+  }
+  static constexpr int mailbox(std::pair<int,int> p){
+    return (p.first + pad) * stride + p.second + pad;
+  }
+  static constexpr int offset(std::pair<int,int> d){
+    return d.first * stride + d.second;
+  }
+
+  // the square under each mailbox cell, -1 on the border
+  static constexpr std::array<std::int16_t, mailbox_size> make_square_at(){
+    std::array<std::int16_t, mailbox_size> table {};
+    for(int m=0; m<mailbox_size; m++){
+      std::pair<int,int> p {m / stride - pad, m % stride - pad};
+      table[m] = contains(p) ? static_cast<std::int16_t>(index(p)) : -1;
+    }
+    return table;
+  }
+  static constexpr std::array<std::int16_t, mailbox_size> square_at = make_square_at();
+};
+
+using StandardGeometry = Geometry<8, 8>;
+// Wider boards the rules are also built for: Capablanca's 10 files by 8 ranks and 10 by 10
+using CapablancaGeometry = Geometry<8, 10>;
+using GrandGeometry = Geometry<10, 10>;
+
+#endif
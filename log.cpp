@@ -0,0 +1,238 @@
+#include "log.hpp"
+#ifndef NDEBUG
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  const char* level_names[] = {"debug", "info", "warning", "error"};
+  const char* event_names[NUM_EVENTS] = {"new_game", "move", "undo", "redo", "resign", "line"};
+
+  // what a record holds: a move, a packed position, or only the key of a position
+  // with too many pieces to pack
+  enum RecordKind : std::uint8_t {MOVE_RECORD, POSITION_RECORD, UNPACKABLE_RECORD};
+
+  /*
+   * One log entry as it sits in the ring: either a move or a whole packed position.
+   */
+  struct LogRecord{
+    std::int64_t nanos;
+    std::uint64_t key;
+    std::uint8_t level;
+    std::uint8_t event;
+    RecordKind kind;
+    Move move;
+    PackedPosition position;
+  };
+
+  /*
+   * A bounded multi-producer multi-consumer queue. Each cell carries a sequence number
+   * that tells producers and consumers whose turn it is, so neither side ever takes a
+   * lock, and a full queue fails a push instead of waiting.
+   */
+  class LogRing{
+  public:
+    static constexpr std::size_t capacity = 4096;
+
+    LogRing(){
+      for(std::size_t i=0; i<capacity; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const LogRecord & r){
+      std::size_t pos = enqueue.load(std::memory_order_relaxed);
+      Cell* cell;
+      for(;;){
+	cell = &cells[pos & (capacity - 1)];
+	std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+	std::intptr_t diff = std::intptr_t(sequence) - std::intptr_t(pos);
+	if(diff==0){
+	  if(enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+	}
+	else if(diff < 0) return false;
+	else pos = enqueue.load(std::memory_order_relaxed);
+      }
+      cell->record = r;
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(LogRecord & r){
+      std::size_t pos = dequeue.load(std::memory_order_relaxed);
+      Cell* cell;
+      for(;;){
+	cell = &cells[pos & (capacity - 1)];
+	std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+	std::intptr_t diff = std::intptr_t(sequence) - std::intptr_t(pos + 1);
+	if(diff==0){
+	  if(dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+	}
+	else if(diff < 0) return false;
+	else pos = dequeue.load(std::memory_order_relaxed);
+      }
+      r = cell->record;
+      cell->sequence.store(pos + capacity, std::memory_order_release);
+      return true;
+    }
+  private:
+    struct Cell{
+      std::atomic<std::size_t> sequence;
+      LogRecord record;
+    };
+    Cell cells[capacity];
+    alignas(64) std::atomic<std::size_t> enqueue{0};
+    alignas(64) std::atomic<std::size_t> dequeue{0};
+  };
+
+  /*
+   * The ring and the thread that empties it. It lives until the program exits, and
+   * writes out whatever is still queued before it goes.
+   */
+  class Logger{
+  public:
+    Logger(): start{Clock::now()} {
+      const char* path = std::getenv("LESS_LOG");
+      if(path!=nullptr) file.open(path, std::ios::app);
+      writer = std::thread(&Logger::drain, this);
+    }
+    ~Logger(){
+      running = false;
+      writer.join();
+    }
+
+    void push(LogRecord & r){
+      r.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+      if(ring.push(r)) accepted.fetch_add(1, std::memory_order_relaxed);
+      else dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush(){
+      while(written.load(std::memory_order_acquire) < accepted.load(std::memory_order_relaxed)){
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    std::atomic<int> level{LOG_INFO};
+  private:
+    void drain(){
+      std::ostream& out = file.is_open() ? static_cast<std::ostream&>(file) : std::clog;
+      std::uint64_t reported = 0;
+      LogRecord r;
+      for(;;){
+	bool stopping = !running.load();
+	bool any = false;
+	while(ring.pop(r)){
+	  write(out, r);
+	  written.fetch_add(1, std::memory_order_release);
+	  any = true;
+	}
+	std::uint64_t lost = dropped.load(std::memory_order_relaxed);
+	if(lost!=reported){
+	  out << "event=dropped count=" << lost - reported << "\n";
+	  reported = lost;
+	  any = true;
+	}
+	if(any) out.flush();
+	else if(stopping) return;
+	else std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+
+    void write(std::ostream & out, const LogRecord & r){
+      char head[96];
+      std::snprintf(head, sizeof(head), "t=%.6f level=%s event=%s key=%016llx",
+		    r.nanos / 1e9, level_names[r.level], event_names[r.event], (unsigned long long)r.key);
+      out << head;
+      if(r.kind==POSITION_RECORD){
+	// rows from the first, runs of empty squares as digits, as in FEN
+	Game g = unpack(r.position);
+	out << " board=";
+	for(int row=0; row<Board::rows; row++){
+	  int empty = 0;
+	  for(int col=0; col<Board::cols; col++){
+	    Piece* piece = g.board.get_piece(Pos{row, col});
+	    if(piece==nullptr){
+	      empty++;
+	      continue;
+	    }
+	    if(empty > 0) out << empty;
+	    empty = 0;
+	    out << piece_letter(piece->name, piece->color);
+	  }
+	  if(empty > 0) out << empty;
+	  if(row + 1 < Board::rows) out << '/';
+	}
+	out << " turn=" << (g.get_turn()==WHITE ? 'w' : 'b');
+      }
+      else if(r.kind==UNPACKABLE_RECORD) out << " board=unpackable";
+      else out << " move=" << move_name(r.move);
+      out << "\n";
+    }
+
+    LogRing ring;
+    Clock::time_point start;
+    std::ofstream file;
+    std::atomic<bool> running{true};
+    std::atomic<std::uint64_t> accepted{0};
+    std::atomic<std::uint64_t> written{0};
+    std::atomic<std::uint64_t> dropped{0};
+    std::thread writer;
+  };
+
+  Logger& logger(){
+    static Logger instance;
+    return instance;
+  }
+}
+
+/**
+ * Records below `level` are discarded before they reach the ring. The default is LOG_INFO.
+ */
+void set_log_level(LogLevel level){
+  logger().level = level;
+}
+
+/**
+ * Logs a move.
+ * @param key the Zobrist key of the position after it
+ */
+void log_move(LogLevel level, LogEvent event, Move m, std::uint64_t key){
+  Logger& l = logger();
+  if(level < l.level.load(std::memory_order_relaxed)) return;
+  LogRecord r;
+  r.key = key;
+  r.level = level;
+  r.event = event;
+  r.kind = MOVE_RECORD;
+  r.move = m;
+  l.push(r);
+}
+
+/**
+ * Logs a whole position, packed as in archive.hpp. A position with more pieces than that
+ * holds is logged as `board=unpackable`, with its key.
+ */
+void log_position(LogLevel level, LogEvent event, Game & g){
+  Logger& l = logger();
+  if(level < l.level.load(std::memory_order_relaxed)) return;
+  LogRecord r;
+  r.key = g.key;
+  r.level = level;
+  r.event = event;
+  r.kind = pack(g, r.position) ? POSITION_RECORD : UNPACKABLE_RECORD;
+  r.move = Move{invalid, invalid};
+  l.push(r);
+}
+
+/**
+ * Waits until everything logged so far has been written.
+ */
+void log_flush(){
+  logger().flush();
+}
+#endif
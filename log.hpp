@@ -0,0 +1,32 @@
+#ifndef LOG_H
+#define LOG_H
+#include <cstdint>
+#include "archive.hpp"
+#include "chess.hpp"
+
+/*
+ * A structured event log. Logging a move or a position copies a small fixed size record
+ * into a lock-free ring buffer and returns; a background thread formats the records and
+ * writes them, one `key=value` line each, to stderr or to the file named by `LESS_LOG`.
+ * When the ring is full records are dropped and counted rather than blocking the caller.
+ *
+ * In builds with NDEBUG every logging function is an empty inline function, so callers
+ * pay nothing.
+ */
+
+enum LogLevel {LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR};
+enum LogEvent {EVENT_NEW_GAME, EVENT_MOVE, EVENT_UNDO, EVENT_REDO, EVENT_RESIGN, EVENT_LINE, NUM_EVENTS};
+
+#ifdef NDEBUG
+inline void set_log_level(LogLevel) {}
+inline void log_move(LogLevel, LogEvent, Move, std::uint64_t) {}
+inline void log_position(LogLevel, LogEvent, Game &) {}
+inline void log_flush() {}
+#else
+void set_log_level(LogLevel);
+void log_move(LogLevel, LogEvent, Move, std::uint64_t key);
+void log_position(LogLevel, LogEvent, Game &);
+void log_flush();
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include <QtWidgets>
 #include <iostream>
+#include <cstdlib>
 #include "MainWindow.hpp"
 #include <QApplication>
 #include <QtCore>
@@ -7,6 +8,7 @@
 #include <QPushButton>
 
 #include "chess.hpp"
+#include "nnue.hpp"
 // #include <optional>
 // #include "grid_button.hpp"
 #include "button_grid.hpp"
@@ -27,10 +29,15 @@ std::function<void()> show_clicked(int i, int j){
 int main(int argc, char* argv[])
 {
     QApplication app(argc, argv);
+    // Evaluation weights, falling back to the built in material network
+    const char* weights = std::getenv("LESS_NNUE");
+    if(!load_network(weights!=nullptr ? weights : "less.nnue") && weights!=nullptr){
+      std::cerr << "using the default evaluation network\n";
+    }
     app.setStyle(QStyleFactory::create("Fusion"));
     // Create a widget
     QWidget *w = new QWidget();
-    auto bg = new ButtonGrid(8,8);
+    auto bg = new ButtonGrid(Board::rows,Board::cols);
     
     w->setLayout(bg->main_layout);
 
@@ -39,5 +46,8 @@ int main(int argc, char* argv[])
     w->show();
 
     // Event loop
-    return app.exec();
+    int result = app.exec();
+    // stops the background search before the pieces it reads are destroyed
+    delete bg;
+    return result;
 }
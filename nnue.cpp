@@ -0,0 +1,306 @@
+#include "nnue.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NNUE_X86 1
+#define NNUE_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
+Network network;
+
+namespace {
+  const char NNUE_MAGIC[8] = {'L','E','S','S','N','N','U','E'};
+  const std::uint32_t NNUE_VERSION = 1;
+
+  bool network_ready = (default_network(network), true);
+
+  /*
+   * The three kernels below are the only parts of the evaluation that touch every
+   * accumulator entry. Each has a scalar version and, on x86, SSE2 and AVX2 versions
+   * compiled for those instruction sets whatever the compiler targets by default; the
+   * widest one the processor runs is picked when the program starts.
+   */
+
+  void add_row_scalar(std::int16_t* acc, const std::int16_t* row){
+    for(int i=0; i<ACCUMULATOR_SIZE; i++) acc[i] += row[i];
+  }
+
+  void sub_row_scalar(std::int16_t* acc, const std::int16_t* row){
+    for(int i=0; i<ACCUMULATOR_SIZE; i++) acc[i] -= row[i];
+  }
+
+  // sum over i of clamp(acc[i], 0, NNUE_CLIP) * weights[i]
+  std::int32_t clipped_dot_scalar(const std::int16_t* acc, const std::int16_t* weights){
+    std::int32_t sum = 0;
+    for(int i=0; i<ACCUMULATOR_SIZE; i++){
+      int a = acc[i] < 0 ? 0 : (acc[i] > NNUE_CLIP ? NNUE_CLIP : acc[i]);
+      sum += a * weights[i];
+    }
+    return sum;
+  }
+
+#ifdef NNUE_X86
+  NNUE_TARGET("sse2") void add_row_sse2(std::int16_t* acc, const std::int16_t* row){
+    for(int i=0; i<ACCUMULATOR_SIZE; i+=8){
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc+i));
+      __m128i r = _mm_load_si128(reinterpret_cast<const __m128i*>(row+i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(acc+i), _mm_add_epi16(a, r));
+    }
+  }
+
+  NNUE_TARGET("sse2") void sub_row_sse2(std::int16_t* acc, const std::int16_t* row){
+    for(int i=0; i<ACCUMULATOR_SIZE; i+=8){
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc+i));
+      __m128i r = _mm_load_si128(reinterpret_cast<const __m128i*>(row+i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(acc+i), _mm_sub_epi16(a, r));
+    }
+  }
+
+  NNUE_TARGET("sse2") std::int32_t clipped_dot_sse2(const std::int16_t* acc, const std::int16_t* weights){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clip = _mm_set1_epi16(NNUE_CLIP);
+    __m128i sum = _mm_setzero_si128();
+    for(int i=0; i<ACCUMULATOR_SIZE; i+=8){
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc+i));
+      __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights+i));
+      a = _mm_min_epi16(_mm_max_epi16(a, zero), clip);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(a, w));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1,0,3,2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(sum);
+  }
+
+  NNUE_TARGET("avx2") void add_row_avx2(std::int16_t* acc, const std::int16_t* row){
+    for(int i=0; i<ACCUMULATOR_SIZE; i+=16){
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc+i));
+      __m256i r = _mm256_load_si256(reinterpret_cast<const __m256i*>(row+i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc+i), _mm256_add_epi16(a, r));
+    }
+  }
+
+  NNUE_TARGET("avx2") void sub_row_avx2(std::int16_t* acc, const std::int16_t* row){
+    for(int i=0; i<ACCUMULATOR_SIZE; i+=16){
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc+i));
+      __m256i r = _mm256_load_si256(reinterpret_cast<const __m256i*>(row+i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc+i), _mm256_sub_epi16(a, r));
+    }
+  }
+
+  NNUE_TARGET("avx2") std::int32_t clipped_dot_avx2(const std::int16_t* acc, const std::int16_t* weights){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i clip = _mm256_set1_epi16(NNUE_CLIP);
+    __m256i sum = _mm256_setzero_si256();
+    for(int i=0; i<ACCUMULATOR_SIZE; i+=16){
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc+i));
+      __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights+i));
+      a = _mm256_min_epi16(_mm256_max_epi16(a, zero), clip);
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, w));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1,0,3,2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(half);
+  }
+#endif
+
+  struct Kernels{
+    const char* name;
+    bool (*supported)();
+    void (*add_row)(std::int16_t*, const std::int16_t*);
+    void (*sub_row)(std::int16_t*, const std::int16_t*);
+    std::int32_t (*clipped_dot)(const std::int16_t*, const std::int16_t*);
+  };
+
+  // widest first
+  const Kernels kernels[] = {
+#ifdef NNUE_X86
+    {"avx2", [](){ return __builtin_cpu_supports("avx2") != 0; }, add_row_avx2, sub_row_avx2, clipped_dot_avx2},
+    {"sse2", [](){ return __builtin_cpu_supports("sse2") != 0; }, add_row_sse2, sub_row_sse2, clipped_dot_sse2},
+#endif
+    {"scalar", [](){ return true; }, add_row_scalar, sub_row_scalar, clipped_dot_scalar},
+  };
+
+  // scalar until the program starts, for games set up by other static initialisers
+  const Kernels* active = &kernels[sizeof(kernels) / sizeof(kernels[0]) - 1];
+
+  const Kernels* pick_kernels(){
+#ifdef NNUE_X86
+    __builtin_cpu_init();
+#endif
+    for(const Kernels& k: kernels)
+      if(k.supported()) return &k;
+    return active;
+  }
+
+  bool kernels_ready = (active = pick_kernels(), true);
+
+  bool read_raw(std::ifstream & in, void* out, std::size_t bytes){
+    in.read(static_cast<char*>(out), bytes);
+    return static_cast<std::size_t>(in.gcount()) == bytes;
+  }
+}
+
+/**
+ * Fills a network with hand-set weights, used when no weights file is loaded.
+ * Units 0 and 1 count white and black material in half pawns, units 2 and 3 count
+ * pieces in the centre of the board; everything else is left at zero.
+ * @param net the network to overwrite
+ */
+void default_network(Network & net){
+  std::memset(&net, 0, sizeof(Network));
+  for(int color=0; color<2; color++){
+    for(int name=0; name<NUM_PIECES; name++){
+      for(int square=0; square<NNUE_SQUARES; square++){
+	int feature = (color*NUM_PIECES + name)*NNUE_SQUARES + square;
+	int row = square / Board::cols, col = square % Board::cols;
+	bool centre = row >= 2 && row <= 5 && col >= 2 && col <= 5;
+	if(name!=KING) net.feature_weights[feature][color==WHITE ? 0 : 1] = piece_values[name] / 50;
+	if(name!=KING && centre) net.feature_weights[feature][color==WHITE ? 2 : 3] = 1;
+      }
+    }
+  }
+  net.output_weights[0] = 50 * NNUE_OUTPUT_DIVISOR;
+  net.output_weights[1] = -50 * NNUE_OUTPUT_DIVISOR;
+  net.output_weights[2] = 10 * NNUE_OUTPUT_DIVISOR;
+  net.output_weights[3] = -10 * NNUE_OUTPUT_DIVISOR;
+}
+
+/**
+ * Replaces the global network with weights read from a file. The file is the 8 byte magic
+ * "LESSNNUE", then version, input count and accumulator size as little endian uint32, then
+ * the feature weights (input major), feature bias and output weights as int16 and the
+ * output bias as int32. On any error the current network is kept.
+ * @param path the weights file
+ * @return whether the weights were loaded
+ */
+bool load_network(const std::string & path){
+  std::ifstream in(path, std::ios::binary);
+  if(!in) return false;
+  char magic[8];
+  std::uint32_t header[3];
+  if(!read_raw(in, magic, sizeof(magic)) || std::memcmp(magic, NNUE_MAGIC, sizeof(magic))!=0
+     || !read_raw(in, header, sizeof(header))){
+    std::cerr << path << ": not a network file\n";
+    return false;
+  }
+  if(header[0]!=NNUE_VERSION || header[1]!=NNUE_INPUTS || header[2]!=ACCUMULATOR_SIZE){
+    std::cerr << path << ": network has the wrong version or shape\n";
+    return false;
+  }
+  Network* loaded = new Network;
+  bool ok = read_raw(in, loaded->feature_weights, sizeof(loaded->feature_weights))
+    && read_raw(in, loaded->feature_bias, sizeof(loaded->feature_bias))
+    && read_raw(in, loaded->output_weights, sizeof(loaded->output_weights))
+    && read_raw(in, &loaded->output_bias, sizeof(loaded->output_bias));
+  if(ok) network = *loaded;
+  else std::cerr << path << ": network file is truncated\n";
+  delete loaded;
+  return ok;
+}
+
+/**
+ * @param piece a piece on the board
+ * @param p the square it stands on
+ * @return the index of the network input for that piece on that square
+ */
+int nnue_feature(const Piece* piece, Pos p){
+  return (piece->color*NUM_PIECES + piece->name)*NNUE_SQUARES + StandardGeometry::index(p);
+}
+
+/**
+ * Recomputes an accumulator from scratch for every piece on a board.
+ * @param acc the accumulator to overwrite
+ * @param board the board it should describe
+ */
+void accumulator_refresh(Accumulator & acc, Board & board){
+  std::memcpy(acc.values, network.feature_bias, sizeof(acc.values));
+  for(int r=0; r<Board::rows; r++){
+    for(int c=0; c<Board::cols; c++){
+      Piece* piece = board.get_piece(Pos{r,c});
+      if(piece!=nullptr) accumulator_add(acc, piece, Pos{r,c});
+    }
+  }
+}
+
+/**
+ * Updates an accumulator for a piece arriving on a square.
+ */
+void accumulator_add(Accumulator & acc, const Piece* piece, Pos p){
+  active->add_row(acc.values, network.feature_weights[nnue_feature(piece, p)]);
+}
+
+/**
+ * Updates an accumulator for a piece leaving a square.
+ */
+void accumulator_remove(Accumulator & acc, const Piece* piece, Pos p){
+  active->sub_row(acc.values, network.feature_weights[nnue_feature(piece, p)]);
+}
+
+/**
+ * Evaluates a game from its accumulator, without looking at the board.
+ * @param g the game to evaluate
+ * @return the score in centipawns for the player whose turn it is
+ */
+int evaluate(Game & g){
+  std::int32_t white = (active->clipped_dot(g.accumulator.values, network.output_weights)
+			+ network.output_bias) / NNUE_OUTPUT_DIVISOR;
+  return g.get_turn()==WHITE ? white : -white;
+}
+
+/**
+ * Evaluates positions stored square by square, as in `PositionBatch`, without building
+ * games. Positions go in blocks: their accumulators start from the bias, then each square
+ * is read across the block and adds its piece's row to the accumulator of its position.
+ * The results are those of `evaluate` on the same positions.
+ * @param squares for every square, the piece code plus one in each position, zero if empty
+ * @param turn the player to move in each position
+ * @param count the number of positions
+ * @param out the score of each position for the player to move
+ */
+void evaluate_batch(const std::uint8_t* const squares[NNUE_SQUARES], const std::uint8_t* turn,
+		    std::size_t count, std::int32_t* out){
+  const std::size_t BLOCK = 64;
+  alignas(32) std::int16_t acc[BLOCK][ACCUMULATOR_SIZE];
+  for(std::size_t begin=0; begin<count; begin+=BLOCK){
+    std::size_t lanes = std::min(BLOCK, count - begin);
+    for(std::size_t lane=0; lane<lanes; lane++) std::memcpy(acc[lane], network.feature_bias, sizeof(acc[lane]));
+    for(int square=0; square<NNUE_SQUARES; square++){
+      const std::uint8_t* codes = squares[square] + begin;
+      for(std::size_t lane=0; lane<lanes; lane++){
+	if(codes[lane]!=0) active->add_row(acc[lane], network.feature_weights[(codes[lane] - 1)*NNUE_SQUARES + square]);
+      }
+    }
+    for(std::size_t lane=0; lane<lanes; lane++){
+      std::int32_t white = (active->clipped_dot(acc[lane], network.output_weights)
+			    + network.output_bias) / NNUE_OUTPUT_DIVISOR;
+      out[begin + lane] = turn[begin + lane]==WHITE ? white : -white;
+    }
+  }
+}
+
+/**
+ * @return the name of the kernels the evaluation runs on: "avx2", "sse2" or "scalar"
+ */
+const char* nnue_kernels(){
+  return active->name;
+}
+
+/**
+ * Switches the evaluation to other kernels, for comparing them. Accumulators are the same
+ * whichever kernels built them, so games in progress stay valid.
+ * @param name "avx2", "sse2" or "scalar"
+ * @return whether those kernels exist in this build and run on this processor
+ */
+bool use_nnue_kernels(const std::string & name){
+  for(const Kernels& k: kernels){
+    if(name==k.name && k.supported()){
+      active = &k;
+      return true;
+    }
+  }
+  return false;
+}
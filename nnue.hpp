@@ -0,0 +1,43 @@
+#ifndef NNUE_H
+#define NNUE_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "chess.hpp"
+
+/*
+ * A small efficiently updatable evaluation network.
+ *
+ * Inputs are one-hot (colour, piece, square) features covering every `Name`, fairy pieces
+ * included. The first layer is a sum of weight rows, one per piece on the board, so a move
+ * only has to subtract and add a few rows to the `Accumulator` kept in each `Game`.
+ * The accumulator then goes through a clipped ReLU and a single output neuron.
+ */
+
+constexpr int NNUE_SQUARES = StandardGeometry::squares;
+constexpr int NNUE_INPUTS = 2 * NUM_PIECES * NNUE_SQUARES;
+constexpr int NNUE_CLIP = 127;
+constexpr int NNUE_OUTPUT_DIVISOR = 64;
+
+struct Network{
+  alignas(32) std::int16_t feature_weights[NNUE_INPUTS][ACCUMULATOR_SIZE];
+  alignas(32) std::int16_t feature_bias[ACCUMULATOR_SIZE];
+  alignas(32) std::int16_t output_weights[ACCUMULATOR_SIZE];
+  std::int32_t output_bias;
+};
+
+extern Network network;
+
+void default_network(Network &);
+bool load_network(const std::string & path);
+int nnue_feature(const Piece*, Pos);
+void accumulator_refresh(Accumulator &, Board &);
+void accumulator_add(Accumulator &, const Piece*, Pos);
+void accumulator_remove(Accumulator &, const Piece*, Pos);
+int evaluate(Game &);
+void evaluate_batch(const std::uint8_t* const squares[NNUE_SQUARES], const std::uint8_t* turn,
+		    std::size_t count, std::int32_t* out);
+const char* nnue_kernels();
+bool use_nnue_kernels(const std::string & name);
+
+#endif
@@ -0,0 +1,37 @@
+#include "ponder.hpp"
+
+/**
+ * @param interval the least number of milliseconds between two reports
+ */
+Ponderer :: Ponderer(int interval):
+  search{}
+  , worker{}
+  , report_interval{interval}
+{}
+
+Ponderer :: ~Ponderer(){
+  stop();
+}
+
+/**
+ * Stops any running search and starts searching a new position.
+ * @param g the position to search, copied for the background thread
+ * @param report called on the background thread with each completed depth
+ * @param limits how far to search and how many lines to rank, by default without end
+ */
+void Ponderer :: start(Game g, SearchReport report, SearchLimits limits){
+  stop();
+  search.resume();
+  worker = std::thread([this, g, report, limits](){
+    search.run(g, limits, report, report_interval);
+  });
+}
+
+/**
+ * Stops the background search and waits for it. The search checks for this at every
+ * node, so the wait is short.
+ */
+void Ponderer :: stop(){
+  search.stop();
+  if(worker.joinable()) worker.join();
+}
@@ -0,0 +1,23 @@
+#ifndef PONDER_H
+#define PONDER_H
+#include <thread>
+#include "search.hpp"
+
+/**
+ * Keeps searching a position on a background thread while the player thinks.
+ * The same `Search`, and so the same transposition table, is used for every position,
+ * which lets the search after a move pick up where the last one left off.
+ */
+class Ponderer{
+public:
+  Ponderer(int report_interval = 250);
+  ~Ponderer();
+  void start(Game, SearchReport, SearchLimits limits = SearchLimits{});
+  void stop();
+private:
+  Search search;
+  std::thread worker;
+  int report_interval;
+};
+
+#endif
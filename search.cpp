@@ -0,0 +1,392 @@
+#include "search.hpp"
+#include "nnue.hpp"
+#include "see.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+  // how far from its score in the last iteration a ranked root move is first searched
+  const int ASPIRATION_WINDOW = 25;
+
+  bool same_move(Move a, Move b){
+    return a.from==b.from && a.to==b.to;
+  }
+
+  // Mate scores are stored relative to the node so they stay right at other plies.
+  int score_to_table(int score, int ply){
+    if(score >= MATE_SCORE - MAX_PLY) return score + ply;
+    if(score <= -MATE_SCORE + MAX_PLY) return score - ply;
+    return score;
+  }
+
+  int score_from_table(int score, int ply){
+    if(score >= MATE_SCORE - MAX_PLY) return score - ply;
+    if(score <= -MATE_SCORE + MAX_PLY) return score + ply;
+    return score;
+  }
+
+  /*
+   * Legal captures that do not lose material, best exchange first, for the quiescence search.
+   */
+  void winning_or_even_captures(Game & g, MoveList & out){
+    std::vector<int, ArenaAllocator<int>> gains;
+    Color c = g.get_turn();
+    for(int i=0; i<Board::rows; i++){
+      for(int j=0; j<Board::cols; j++){
+	Pos pos {i,j};
+	Piece* piece = g.board.get_piece(pos);
+	if(piece==nullptr || piece->color!=c) continue;
+	MoveSet* moves = piece->possible_moves(g, pos);
+	for(const Pos& to: *moves){
+	  if(g.board.get_piece(to)==nullptr) continue;
+	  int gain = see(g, pos, to);
+	  if(gain < 0 || !safe_move(g, pos, to)) continue;
+	  std::size_t k = out.size();
+	  out.push_back(Move{pos, to});
+	  gains.push_back(gain);
+	  for(; k>0 && gains[k-1] < gain; k--){
+	    std::swap(out[k], out[k-1]);
+	    std::swap(gains[k], gains[k-1]);
+	  }
+	}
+	free_move_set(moves);
+      }
+    }
+  }
+}
+
+TranspositionTable :: TranspositionTable(std::size_t size):
+  entries(size)
+{
+  clear();
+}
+
+/**
+ * @param key the Zobrist key of a position
+ * @return the entry for the position, or nullptr if it is not in the table
+ */
+TranspositionTable::Entry* TranspositionTable :: probe(std::uint64_t key){
+  Entry& e = entries[key % entries.size()];
+  return e.bound!=NONE && e.key==key ? &e : nullptr;
+}
+
+/**
+ * Records a search result, replacing whatever shared its slot.
+ */
+void TranspositionTable :: store(std::uint64_t key, int depth, int score, Bound bound, Move m){
+  Entry& e = entries[key % entries.size()];
+  e.key = key;
+  e.score = static_cast<std::int16_t>(score);
+  e.depth = static_cast<std::int8_t>(depth);
+  e.bound = bound;
+  e.move[0] = m.from.first;
+  e.move[1] = m.from.second;
+  e.move[2] = m.to.first;
+  e.move[3] = m.to.second;
+}
+
+void TranspositionTable :: clear(){
+  std::fill(entries.begin(), entries.end(), Entry{0, 0, 0, NONE, {-1,-1,-1,-1}});
+}
+
+
+Search :: Search(std::size_t tt_entries):
+  table{tt_entries}
+  , stopped{false}
+  , aborted{false}
+  , limits{}
+  , start{}
+  , node_count{0}
+  , root_moves{}
+  , root_scores{}
+  , pv{}
+  , pv_length{0}
+  , report{nullptr}
+  , report_interval{0}
+  , pending{false}
+  , latest{}
+  , last_report{}
+{}
+
+/**
+ * Searches a position with increasing depth until a limit is reached, the game is decided
+ * or `stop` is called. An interrupted iteration is thrown away, except that a first
+ * iteration cut short is kept for the moves it did score, reported as depth 0, so that
+ * there is always a move to play.
+ * @param g the position to search
+ * @param l when to give up
+ * @param r called on this thread with each completed iteration, may be nullptr
+ * @param interval the least number of milliseconds between two calls to r
+ * @return the deepest completed iteration, or the partial first one; its pv is empty when
+ * there are no legal moves
+ */
+SearchInfo Search :: run(Game g, SearchLimits l, SearchReport r, int interval){
+  ArenaScope scratch;
+  limits = l;
+  report = r;
+  report_interval = interval;
+  pending = false;
+  aborted = false;
+  node_count = 0;
+  start = Clock::now();
+  last_report = start - std::chrono::milliseconds(interval);
+
+  SearchInfo best = make_info(0, 0);
+  MoveList moves;
+  legal_moves(g, moves);
+  if(moves.empty()){
+    // as in_checkmate and in_draw: stuck while the opponent can move is a loss
+    best = make_info(1, has_possible_moves(g, other_color(g.get_turn())) ? -MATE_SCORE : 0);
+    latest = best;
+    pending = true;
+    report_pending(true);
+    return best;
+  }
+  Move hash_move {invalid, invalid};
+  if(TranspositionTable::Entry* e = table.probe(g.key))
+    hash_move = Move{Pos{e->move[0], e->move[1]}, Pos{e->move[2], e->move[3]}};
+  order_moves(g, moves, hash_move);
+  root_moves.assign(moves.begin(), moves.end());
+  root_scores.clear();
+
+  for(int depth=1; depth<=limits.depth && depth<MAX_PLY; depth++){
+    std::vector<PvLine> lines;
+    search_root(g, depth, lines);
+    // a cut short first iteration still beats having no move at all
+    if(should_stop() && (best.depth > 0 || lines.empty())) break;
+    best = make_info(should_stop() ? 0 : depth, lines[0].score);
+    best.pv = lines[0].pv;
+    best.lines = std::move(lines);
+    latest = best;
+    pending = true;
+    report_pending(false);
+    if(std::abs(best.score) >= MATE_SCORE - MAX_PLY || should_stop()) break;
+  }
+  report_pending(true);
+  return best;
+}
+
+void Search :: stop(){
+  stopped = true;
+}
+
+void Search :: resume(){
+  stopped = false;
+}
+
+/**
+ * Forgets everything learned by earlier searches.
+ */
+void Search :: clear(){
+  table.clear();
+}
+
+/**
+ * @return the number of nodes visited by the last run
+ */
+std::uint64_t Search :: nodes() const{
+  return node_count;
+}
+
+bool Search :: should_stop(){
+  if(aborted || stopped.load(std::memory_order_relaxed)) return true;
+  if(limits.nodes!=0 && node_count >= limits.nodes) aborted = true;
+  if((node_count & 255) == 0){
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    if(limits.millis!=0 && elapsed.count() >= limits.millis) aborted = true;
+    report_pending(false);
+  }
+  return aborted;
+}
+
+/**
+ * Scores every root move in one pass. While fewer than `multi_pv` lines are ranked a move
+ * needs an exact score: it is searched with a full window, or a narrow one around its score
+ * in the last iteration that is widened if the score falls outside. After that each move is
+ * first tested with a null window at the score of the worst ranked line, and only searched
+ * again with a full window above that score when it beats it. The ranked moves are then
+ * moved to the front of `root_moves`, best first, so the next iteration tries them first.
+ * @param g the position, at the root
+ * @param depth the depth of this iteration
+ * @param lines overwritten with the ranked lines, best first; when the search is
+ * stopped part way they cover the moves scored so far
+ */
+void Search :: search_root(Game & g, int depth, std::vector<PvLine> & lines){
+  const std::size_t wanted = std::max(1, limits.multi_pv);
+  lines.clear();
+  node_count++;
+  for(std::size_t i=0; i<root_moves.size(); i++){
+    const Move m = root_moves[i];
+    const int alpha = lines.size() < wanted ? -INFINITE_SCORE : lines.back().score;
+    // a null window at the worst ranked line, or a window around the move's last score
+    int lower = alpha, upper = alpha + 1;
+    if(alpha == -INFINITE_SCORE){
+      bool guessed = i < root_scores.size();
+      lower = guessed ? root_scores[i] - ASPIRATION_WINDOW : -INFINITE_SCORE;
+      upper = guessed ? root_scores[i] + ASPIRATION_WINDOW : INFINITE_SCORE;
+    }
+    Undo u = g.make_move(m.from, m.to);
+    int score = -negamax(g, depth - 1, -upper, -lower, 1);
+    while(!should_stop() && ((score <= lower && lower > alpha) || (score >= upper && upper < INFINITE_SCORE))){
+      lower = score <= lower ? alpha : std::max(alpha, lower);
+      upper = INFINITE_SCORE;
+      score = -negamax(g, depth - 1, -upper, -lower, 1);
+    }
+    g.unmake_move(u);
+    if(should_stop()) break;
+    if(score <= alpha) continue;
+    PvLine line {score, {m}};
+    line.pv.insert(line.pv.end(), pv[1] + 1, pv[1] + pv_length[1]);
+    auto at = std::upper_bound(lines.begin(), lines.end(), score,
+			       [](int s, const PvLine& l){ return s > l.score; });
+    lines.insert(at, std::move(line));
+    if(lines.size() > wanted) lines.pop_back();
+  }
+  if(lines.empty()) return;
+  if(!should_stop()){
+    table.store(g.key, depth, score_to_table(lines[0].score, 0), TranspositionTable::EXACT, lines[0].pv[0]);
+  }
+  // the ranked moves first, best first, then the rest in their old order
+  std::vector<Move> order;
+  order.reserve(root_moves.size());
+  root_scores.clear();
+  for(const PvLine& l: lines){
+    order.push_back(l.pv[0]);
+    root_scores.push_back(l.score);
+  }
+  for(const Move& m: root_moves){
+    if(std::none_of(lines.begin(), lines.end(), [&m](const PvLine& l){ return same_move(l.pv[0], m); }))
+      order.push_back(m);
+  }
+  root_moves = std::move(order);
+}
+
+int Search :: negamax(Game & g, int depth, int alpha, int beta, int ply){
+  pv_length[ply] = ply;
+  if(should_stop()) return 0;
+  if(depth <= 0) return quiescence(g, alpha, beta, ply);
+  node_count++;
+  if(ply >= MAX_PLY - 1) return evaluate(g);
+
+  Move hash_move {invalid, invalid};
+  if(TranspositionTable::Entry* e = table.probe(g.key)){
+    hash_move = Move{Pos{e->move[0], e->move[1]}, Pos{e->move[2], e->move[3]}};
+    int score = score_from_table(e->score, ply);
+    if(ply > 0 && e->depth >= depth){
+      if(e->bound==TranspositionTable::EXACT) return score;
+      if(e->bound==TranspositionTable::LOWER && score >= beta) return score;
+      if(e->bound==TranspositionTable::UPPER && score <= alpha) return score;
+    }
+  }
+
+  ArenaScope ply_scratch;
+  MoveList moves;
+  moves.reserve(64);
+  legal_moves(g, moves);
+  if(moves.empty()){
+    // as in_checkmate and in_draw: stuck while the opponent can move is a loss
+    return has_possible_moves(g, other_color(g.get_turn())) ? -MATE_SCORE + ply : 0;
+  }
+  order_moves(g, moves, hash_move);
+
+  int original_alpha = alpha;
+  int best = -INFINITE_SCORE;
+  Move best_move = moves[0];
+  for(const Move& m: moves){
+    Undo u = g.make_move(m.from, m.to);
+    int score = -negamax(g, depth - 1, -beta, -alpha, ply + 1);
+    g.unmake_move(u);
+    if(should_stop()) return 0;
+    if(score > best){
+      best = score;
+      best_move = m;
+    }
+    if(score > alpha){
+      alpha = score;
+      pv[ply][ply] = m;
+      for(int i=ply+1; i<pv_length[ply+1]; i++) pv[ply][i] = pv[ply+1][i];
+      pv_length[ply] = std::max(pv_length[ply+1], ply + 1);
+      if(alpha >= beta) break;
+    }
+  }
+  TranspositionTable::Bound bound = best >= beta ? TranspositionTable::LOWER
+    : best > original_alpha ? TranspositionTable::EXACT : TranspositionTable::UPPER;
+  table.store(g.key, depth, score_to_table(best, ply), bound, best_move);
+  return best;
+}
+
+int Search :: quiescence(Game & g, int alpha, int beta, int ply){
+  pv_length[ply] = ply;
+  if(should_stop()) return 0;
+  node_count++;
+  int stand_pat = evaluate(g);
+  if(ply >= MAX_PLY - 1 || stand_pat >= beta) return stand_pat;
+  if(stand_pat > alpha) alpha = stand_pat;
+
+  ArenaScope ply_scratch;
+  MoveList captures;
+  captures.reserve(16);
+  winning_or_even_captures(g, captures);
+  for(const Move& m: captures){
+    Undo u = g.make_move(m.from, m.to);
+    int score = -quiescence(g, -beta, -alpha, ply + 1);
+    g.unmake_move(u);
+    if(should_stop()) return 0;
+    if(score > alpha){
+      alpha = score;
+      if(alpha >= beta) break;
+    }
+  }
+  return alpha;
+}
+
+/**
+ * Puts the hash move first, then captures by static exchange value, then quiet moves,
+ * then captures that lose material.
+ */
+void Search :: order_moves(Game & g, MoveList & moves, Move hash_move){
+  std::vector<int, ArenaAllocator<int>> keys;
+  keys.reserve(moves.size());
+  for(const Move& m: moves){
+    if(same_move(m, hash_move)) keys.push_back(INFINITE_SCORE);
+    else if(g.board.get_piece(m.to)==nullptr) keys.push_back(0);
+    else{
+      int gain = see(g, m.from, m.to);
+      keys.push_back(gain >= 0 ? gain + 1 : gain - 1);
+    }
+  }
+  // insertion sort, the lists are short
+  for(std::size_t i=1; i<moves.size(); i++){
+    Move m = moves[i];
+    int k = keys[i];
+    std::size_t j = i;
+    for(; j>0 && keys[j-1] < k; j--){
+      moves[j] = moves[j-1];
+      keys[j] = keys[j-1];
+    }
+    moves[j] = m;
+    keys[j] = k;
+  }
+}
+
+SearchInfo Search :: make_info(int depth, int score){
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+  SearchInfo info {depth, score, node_count, static_cast<int>(elapsed.count()), {}, {}};
+  return info;
+}
+
+/**
+ * Hands the latest completed iteration to the report callback, unless one was
+ * reported less than `report_interval` milliseconds ago.
+ * @param force report regardless of the interval
+ */
+void Search :: report_pending(bool force){
+  if(!pending || !report) return;
+  auto now = Clock::now();
+  if(!force && now - last_report < std::chrono::milliseconds(report_interval)) return;
+  pending = false;
+  last_report = now;
+  report(latest);
+}
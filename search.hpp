@@ -0,0 +1,127 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "chess.hpp"
+
+constexpr int MAX_PLY = 64;
+constexpr int MATE_SCORE = 30000;
+constexpr int INFINITE_SCORE = 32000;
+
+/**
+ * When a search should give up. Zero means no limit. `multi_pv` is how many of the best
+ * root moves to rank; root moves outside them only need a null window test, so ranking
+ * every move costs a few times a single line rather than a search per move.
+ */
+struct SearchLimits{
+  int depth = MAX_PLY;
+  std::uint64_t nodes = 0;
+  int millis = 0;
+  int multi_pv = 1;
+};
+
+/**
+ * A root move's score and the line the search expects after it.
+ *
+ * A mate is scored as `MATE_SCORE` less the plies to it, negative for the side being
+ * mated, counted along the line's own moves; entries taken from the transposition table
+ * are converted to the ply they are found at. Two lines that reach the same mate by moves
+ * played in a different order can therefore differ by a ply, say -29998 against -29999.
+ * They still rank correctly, mates before everything else and shorter mates first.
+ */
+struct PvLine{
+  int score;
+  std::vector<Move> pv;
+};
+
+/**
+ * The result of one completed iteration of the search. `lines` holds the ranked root
+ * moves, best first, as many as `SearchLimits::multi_pv` asked for and the position
+ * has; `score` and `pv` repeat the best of them. Depth 0 is a first iteration stopped
+ * before it scored every root move, ranking only those it did.
+ */
+struct SearchInfo{
+  int depth;
+  int score;
+  std::uint64_t nodes;
+  int millis;
+  std::vector<Move> pv;
+  std::vector<PvLine> lines;
+};
+
+using SearchReport = std::function<void(const SearchInfo &)>;
+
+/**
+ * A fixed size hash table of search results, shared by successive searches so that
+ * work on one position carries over to the positions after it.
+ */
+class TranspositionTable{
+public:
+  enum Bound : std::uint8_t {NONE, UPPER, LOWER, EXACT};
+  struct Entry{
+    std::uint64_t key;
+    std::int16_t score;
+    std::int8_t depth;
+    Bound bound;
+    std::int8_t move[4];
+  };
+
+  explicit TranspositionTable(std::size_t entries = 1 << 18);
+  Entry* probe(std::uint64_t key);
+  void store(std::uint64_t key, int depth, int score, Bound, Move);
+  void clear();
+private:
+  std::vector<Entry> entries;
+};
+
+
+/**
+ * An iterative deepening alpha-beta search over `Game::make_move`, evaluated with the
+ * network in nnue.hpp. Captures are ordered and pruned with `see`. Transient move lists
+ * live in the calling thread's arena.
+ *
+ * Each iteration scores all root moves in one pass, see `search_root`, so ranking
+ * several lines with `multi_pv` shares the pass and the transposition table.
+ *
+ * `run` may be called from one thread at a time. `stop` may be called from any thread;
+ * it makes the current run, and any later one, return as soon as possible until `resume`.
+ */
+class Search{
+public:
+  explicit Search(std::size_t tt_entries = 1 << 18);
+  SearchInfo run(Game, SearchLimits, SearchReport report = nullptr, int report_interval = 0);
+  void stop();
+  void resume();
+  void clear();
+  std::uint64_t nodes() const;
+private:
+  void search_root(Game &, int depth, std::vector<PvLine> & lines);
+  int negamax(Game &, int depth, int alpha, int beta, int ply);
+  int quiescence(Game &, int alpha, int beta, int ply);
+  bool should_stop();
+  void order_moves(Game &, MoveList &, Move hash_move);
+  SearchInfo make_info(int depth, int score);
+  void report_pending(bool force);
+
+  TranspositionTable table;
+  std::atomic<bool> stopped;
+  bool aborted;
+  SearchLimits limits;
+  std::chrono::steady_clock::time_point start;
+  std::uint64_t node_count;
+  std::vector<Move> root_moves;
+  std::vector<int> root_scores;
+  Move pv[MAX_PLY][MAX_PLY];
+  int pv_length[MAX_PLY];
+
+  SearchReport report;
+  int report_interval;
+  bool pending;
+  SearchInfo latest;
+  std::chrono::steady_clock::time_point last_report;
+};
+
+#endif
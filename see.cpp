@@ -0,0 +1,99 @@
+#include "see.hpp"
+#include <algorithm>
+#include <climits>
+
+/**
+ * Finds the cheapest piece of a color that can move onto a square. Attacks come from the
+ * pieces' own movement functions, so asymmetric fairy pieces and pawns are handled the
+ * same way as during play.
+ * @param g the game, left unchanged
+ * @param to the square being attacked
+ * @param c the color of the attackers
+ * @return the position of the least valuable attacker, or `invalid` when there is none
+ */
+Pos least_valuable_attacker(Game & g, Pos to, Color c){
+  ArenaScope scratch;
+  bool flipping = c!=g.get_turn();
+  if(flipping) g.end_turn();
+  Pos best = invalid;
+  int best_value = INT_MAX;
+  for(int i=0; i<Board::rows; i++){
+    for(int j=0; j<Board::cols; j++){
+      Pos pos {i,j};
+      Piece* piece = g.board.get_piece(pos);
+      if(piece==nullptr || piece->color!=c || piece_values[piece->name]>=best_value) continue;
+      MoveSet* moves = piece->possible_moves(g, pos);
+      if(moves->find(to)!=moves->end()){
+	best = pos;
+	best_value = piece_values[piece->name];
+      }
+    }
+  }
+  if(flipping) g.end_turn();
+  return best;
+}
+
+/**
+ * Static exchange evaluation. Plays out every capture on `to`, each side always
+ * recapturing with its least valuable attacker and stopping when that no longer pays.
+ * Pieces behind the capturers join in as the board changes. King safety is not
+ * checked beyond the king's high value.
+ * @param g the game, restored before returning
+ * @param from the position of the piece making the first capture
+ * @param to the square being captured on, which may be empty
+ * @return the material won, in centipawns, for the side making the first capture
+ */
+int see(Game & g, Pos from, Pos to){
+  Piece* attacker = g.board.get_piece(from);
+  if(attacker==nullptr) return 0;
+  Piece* target = g.board.get_piece(to);
+  bool flipping = attacker->color!=g.get_turn();
+  if(flipping) g.end_turn();
+
+  int gain[33];
+  Undo captures[32];
+  int made = 0;
+  int d = 0;
+  gain[0] = target!=nullptr ? piece_values[target->name] : 0;
+  Pos attacker_pos = from;
+  do{
+    d++;
+    // what this capture is worth if the opponent recaptures
+    gain[d] = piece_values[attacker->name] - gain[d-1];
+    if(std::max(-gain[d-1], gain[d]) < 0) break;
+    captures[made++] = g.make_move(attacker_pos, to);
+    attacker_pos = least_valuable_attacker(g, to, g.get_turn());
+    attacker = attacker_pos==invalid ? nullptr : g.board.get_piece(attacker_pos);
+  } while(attacker!=nullptr && made < 32);
+  while(--d) gain[d-1] = -std::max(-gain[d-1], gain[d]);
+
+  while(made > 0) g.unmake_move(captures[--made]);
+  if(flipping) g.end_turn();
+  return gain[0];
+}
+
+/**
+ * Finds the enemy pieces a color can capture while winning material, counting every
+ * recapture on the square.
+ * @param g the current game
+ * @param c the color making the captures
+ * @return the squares of those enemy pieces, to be released with `free_move_set`
+ */
+MoveSet* winning_captures(Game g, Color c){
+  MoveSet* targets = make_move_set();
+  if(c!=g.get_turn()) g.end_turn();
+  for(int i=0; i<Board::rows; i++){
+    for(int j=0; j<Board::cols; j++){
+      Pos pos {i,j};
+      Piece* piece = g.board.get_piece(pos);
+      if(piece==nullptr || piece->color!=c) continue;
+      MoveSet* moves = piece->possible_moves(g, pos);
+      for(const Pos& to: *moves){
+	if(g.board.get_piece(to)==nullptr || targets->find(to)!=targets->end()) continue;
+	if(see(g, pos, to) > 0 && safe_move(g, pos, to)) targets->insert(to);
+      }
+      free_move_set(moves);
+    }
+  }
+  return targets;
+}
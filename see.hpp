@@ -0,0 +1,9 @@
+#ifndef SEE_H
+#define SEE_H
+#include "chess.hpp"
+
+Pos least_valuable_attacker(Game &, Pos, Color);
+int see(Game &, Pos from, Pos to);
+MoveSet* winning_captures(Game, Color);
+
+#endif
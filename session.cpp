@@ -0,0 +1,201 @@
+#include "session.hpp"
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace {
+  // Ids are the shard in the low byte, then the slot, then the slot's generation,
+  // so the id of a closed game is never accepted for the game that reuses its slot.
+  std::uint64_t make_id(std::uint32_t shard, std::uint32_t slot, std::uint32_t generation){
+    return (std::uint64_t(generation) << 32) | (std::uint64_t(slot) << 8) | shard;
+  }
+}
+
+/**
+ * Puts the pieces back in their starting position and forgets the history. The two starting
+ * positions are built once, so new games don't create pieces of their own.
+ * @param fairy whether to use the fairy starting position
+ */
+void CompactGame :: reset(bool fairy){
+  static const CompactGame starts[2] = {[](){ CompactGame c; Game g {false}; c.load(g); return c; }(),
+					[](){ CompactGame c; Game g {true}; c.load(g); return c; }()};
+  std::copy(std::begin(starts[fairy].squares), std::end(starts[fairy].squares), squares);
+  turn = starts[fairy].turn;
+  undo_history = std::vector<CompactMove>{};
+  redo_history = std::vector<CompactMove>{};
+}
+
+/**
+ * Stores the position of a game and forgets its history.
+ * @param g the game to store
+ */
+void CompactGame :: load(Game & g){
+  position_codes(g, squares);
+  turn = g.get_turn();
+  undo_history.clear();
+  redo_history.clear();
+}
+
+/**
+ * @return the stored position as a game, built from the shared canonical pieces
+ */
+Game CompactGame :: expand() const{
+  return codes_game(squares, Color(turn));
+}
+
+/**
+ * Plays a move on the stored position without checking it.
+ */
+void CompactGame :: play(CompactMove m){
+  squares[m.to] = squares[m.from];
+  squares[m.from] = 0;
+  turn = other_color(Color(turn));
+}
+
+/**
+ * Takes back a move played with `play`.
+ * @return the same move, for the other history stack
+ */
+CompactMove CompactGame :: take_back(CompactMove m){
+  squares[m.from] = squares[m.to];
+  squares[m.to] = m.captured;
+  turn = other_color(Color(turn));
+  return m;
+}
+
+
+SessionStore :: SessionStore(int count):
+  shards{}
+  , next_shard{0}
+{
+  for(int i=0; i<count && i<256; i++) shards.emplace_back(new Shard);
+}
+
+SessionStore::Shard& SessionStore :: shard_of(std::uint64_t id){
+  return *shards[(id & 0xff) % shards.size()];
+}
+
+/**
+ * @return the live slot an id refers to, or nullptr. The shard must be locked.
+ */
+SessionStore::Slot* SessionStore :: find(Shard & shard, std::uint64_t id){
+  std::uint32_t slot = (id >> 8) & 0xffffff;
+  if((id & 0xff) >= shards.size() || slot >= shard.slots.size()) return nullptr;
+  Slot& s = shard.slots[slot];
+  return s.live && s.generation==std::uint32_t(id >> 32) ? &s : nullptr;
+}
+
+std::string SessionStore :: create(bool fairy){
+  std::uint32_t index = next_shard++ % shards.size();
+  Shard& shard = *shards[index];
+  std::lock_guard<std::mutex> guard(shard.lock);
+  std::uint32_t slot;
+  if(!shard.free.empty()){
+    slot = shard.free.back();
+    shard.free.pop_back();
+  }
+  else{
+    if(shard.slots.size() > 0xffffff) return "ERR too many games";
+    slot = shard.slots.size();
+    shard.slots.push_back(Slot{CompactGame{}, 0, false});
+  }
+  Slot& s = shard.slots[slot];
+  s.game.reset(fairy);
+  s.game.scores[0] = s.game.scores[1] = 0;
+  s.live = true;
+  return "OK " + std::to_string(make_id(index, slot, s.generation));
+}
+
+/**
+ * @return the number of open games
+ */
+std::size_t SessionStore :: size(){
+  std::size_t count = 0;
+  for(auto& shard: shards){
+    std::lock_guard<std::mutex> guard(shard->lock);
+    count += shard->slots.size() - shard->free.size();
+  }
+  return count;
+}
+
+/**
+ * Runs one request of the protocol described in session.hpp.
+ * @param request one line, without its newline
+ * @return the answer, without a newline
+ */
+std::string SessionStore :: handle(const std::string & request){
+  std::istringstream in(request);
+  std::string command;
+  in >> command;
+  if(command=="NEW"){
+    std::string variant;
+    in >> variant;
+    return create(variant=="fairy");
+  }
+
+  std::uint64_t id;
+  if(!(in >> id)) return "ERR bad request";
+  Shard& shard = shard_of(id);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  Slot* slot = find(shard, id);
+  if(slot==nullptr) return "ERR no such game";
+  CompactGame& game = slot->game;
+
+  if(command=="MOVE"){
+    std::string from_name, to_name;
+    in >> from_name >> to_name;
+    Pos from = parse_square(from_name), to = parse_square(to_name);
+    if(from==invalid || to==invalid) return "ERR bad square";
+    Game g = game.expand();
+    if(!legal_move(g, from, to)) return "ERR illegal move";
+    int from_square = StandardGeometry::index(from), to_square = StandardGeometry::index(to);
+    CompactMove m {std::uint8_t(from_square), std::uint8_t(to_square), game.squares[to_square]};
+    game.play(m);
+    game.undo_history.push_back(m);
+    game.redo_history.clear();
+    g.make_move(from, to);
+    if(in_checkmate(g)){
+      game.scores[other_color(g.get_turn())] += 1;
+      return "OK CHECKMATE";
+    }
+    return in_draw(g) ? "OK DRAW" : "OK PLAYING";
+  }
+  if(command=="UNDO" || command=="REDO"){
+    bool undo = command=="UNDO";
+    std::vector<CompactMove>& from = undo ? game.undo_history : game.redo_history;
+    std::vector<CompactMove>& to = undo ? game.redo_history : game.undo_history;
+    if(from.empty()) return undo ? "ERR nothing to undo" : "ERR nothing to redo";
+    CompactMove m = from.back();
+    from.pop_back();
+    if(undo) game.take_back(m);
+    else game.play(m);
+    to.push_back(m);
+    return "OK";
+  }
+  if(command=="RESET" || command=="RESIGN"){
+    if(command=="RESIGN"){
+      Game g = game.expand();
+      if(!in_checkmate(g)) game.scores[other_color(g.get_turn())] += 1;
+    }
+    game.reset(false);
+    if(command=="RESET") return "OK";
+    return "OK " + std::to_string(game.scores[WHITE]) + " " + std::to_string(game.scores[BLACK]);
+  }
+  if(command=="SHOW"){
+    std::string board(StandardGeometry::squares, '.');
+    for(int square=0; square<StandardGeometry::squares; square++){
+      if(game.squares[square]==0) continue;
+      int code = game.squares[square] - 1;
+      board[square] = piece_letter(Name(code % NUM_PIECES), Color(code / NUM_PIECES));
+    }
+    return std::string("OK ") + (game.turn==WHITE ? "w " : "b ") + board;
+  }
+  if(command=="CLOSE"){
+    slot->live = false;
+    slot->generation++;
+    game.reset(false);
+    shard.free.push_back((id >> 8) & 0xffffff);
+    return "OK";
+  }
+  return "ERR unknown command";
+}
@@ -0,0 +1,85 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "chess.hpp"
+
+/**
+ * A move as stored in a session: the two square indices and the code of the captured
+ * piece plus one, zero when nothing was captured.
+ */
+struct CompactMove{
+  std::uint8_t from;
+  std::uint8_t to;
+  std::uint8_t captured;
+};
+
+/**
+ * A game as kept by the session server while nobody is moving in it. Instead of full
+ * `Game` copies for every move it stores one position and the moves that lead away
+ * from it, which is all undo and redo need.
+ */
+struct CompactGame{
+  std::uint8_t squares[StandardGeometry::squares];   // piece code plus one, zero when empty
+  std::uint8_t turn;
+  std::uint16_t scores[2];
+  std::vector<CompactMove> undo_history;
+  std::vector<CompactMove> redo_history;
+
+  void reset(bool fairy);
+  void load(Game &);
+  Game expand() const;
+  void play(CompactMove);
+  CompactMove take_back(CompactMove);
+};
+
+
+/**
+ * Many independent games behind a text protocol, one request per line:
+ *
+ *   NEW [fairy]            -> OK <id>
+ *   MOVE <id> <from> <to>  -> OK PLAYING|CHECKMATE|DRAW, squares named like e2
+ *   UNDO <id>, REDO <id>   -> OK
+ *   RESET <id>             -> OK
+ *   RESIGN <id>            -> OK <white score> <black score>
+ *   SHOW <id>              -> OK <w|b> <64 squares, KQRBNP plus D paladin, C coward,
+ *                             S samurai, upper case for white, . for empty>
+ *   CLOSE <id>             -> OK
+ *
+ * Failures answer "ERR <reason>". Moves are checked with `legal_move`, the same rules as
+ * `Model::update_game`, and scores follow `Model`: a checkmate or a resignation scores a
+ * point for the other player.
+ *
+ * Games live in slots pooled per shard. Each shard has its own lock, so requests for
+ * different games proceed in parallel on as many threads as call `handle`.
+ */
+class SessionStore{
+public:
+  explicit SessionStore(int shards = 64);
+  std::string handle(const std::string & request);
+  std::size_t size();
+private:
+  struct Slot{
+    CompactGame game;
+    std::uint32_t generation;
+    bool live;
+  };
+  struct Shard{
+    std::mutex lock;
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> free;
+  };
+
+  std::string create(bool fairy);
+  Slot* find(Shard &, std::uint64_t id);
+  Shard& shard_of(std::uint64_t id);
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<std::uint32_t> next_shard;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "archive.hpp"
+#include "random_games.hpp"
+
+/*
+ * Packs and unpacks positions from random games and hand-made boards, then stores them in a
+ * PositionStore and checks that its index survives closing, going missing, going stale and
+ * lagging behind the records.
+ *
+ * The rules have no castling and no en passant, so a position is its pieces and the side to
+ * move, and those are what the round trip checks: every kind of piece in both colours,
+ * fairy pieces included, on every square, with either side to move.
+ */
+
+namespace {
+  int failures = 0;
+
+  void check(bool ok, const char* what){
+    if(ok) return;
+    std::printf("failed: %s\n", what);
+    failures++;
+  }
+
+  bool same_position(Game & a, Game & b){
+    if(a.get_turn()!=b.get_turn() || a.key!=b.key) return false;
+    for(int square=0; square<StandardGeometry::squares; square++){
+      Piece* p = a.board.at(square);
+      Piece* q = b.board.at(square);
+      if((p==nullptr)!=(q==nullptr)) return false;
+      if(p!=nullptr && (p->name!=q->name || p->color!=q->color)) return false;
+    }
+    return std::memcmp(a.accumulator.values, b.accumulator.values, sizeof(a.accumulator.values))==0;
+  }
+
+  void round_trip(Game & g, std::vector<PackedPosition> & packed){
+    PackedPosition p;
+    check(pack(g, p), "a legal position packs");
+    Game u = unpack(p);
+    PackedPosition q;
+    pack(u, q);
+    check(p==q, "packing an unpacked position gives the same bytes");
+    check(same_position(g, u), "an unpacked position matches the packed one");
+    packed.push_back(p);
+  }
+
+  void played_positions(std::vector<PackedPosition> & packed){
+    std::mt19937_64 rng(7);
+    random_games(rng, 60, 100, [&packed](Game & g, int, int, Move){ round_trip(g, packed); });
+  }
+
+  // every piece on every square with either side to move, and full boards of mixed pieces
+  void made_up_boards(std::vector<PackedPosition> & packed){
+    for(int name=0; name<NUM_PIECES; name++){
+      for(int color=0; color<2; color++){
+	for(int square=0; square<StandardGeometry::squares; square++){
+	  Board board = Board::empty();
+	  board.set_piece(StandardGeometry::pos(square), canonical_piece(Name(name), Color(color)));
+	  Game g{board, Color((square + name) % 2)};
+	  round_trip(g, packed);
+	}
+      }
+    }
+    std::mt19937_64 rng(11);
+    for(int n=0; n<200; n++){
+      Board board = Board::empty();
+      for(int k=0; k<PACKED_MAX_PIECES; k++){
+	Pos p = StandardGeometry::pos(rng() % StandardGeometry::squares);
+	board.set_piece(p, canonical_piece(Name(rng() % NUM_PIECES), Color(rng() % 2)));
+      }
+      Game g{board, Color(n % 2)};
+      round_trip(g, packed);
+    }
+    Game empty{Board::empty(), BLACK};
+    round_trip(empty, packed);
+    Game crowded{Board::empty(), WHITE};
+    for(int square=0; square<=PACKED_MAX_PIECES; square++)
+      crowded.board.set_piece(StandardGeometry::pos(square), canonical_piece(SAMURAI, WHITE));
+    PackedPosition p;
+    check(!pack(crowded, p), "a board with more than 32 pieces does not pack");
+  }
+
+  bool all_found(PositionStore & store, const std::vector<PackedPosition> & packed){
+    for(const PackedPosition & p: packed){
+      std::int64_t record = store.find(p);
+      if(record < 0 || !(store.at(record)==p)) return false;
+    }
+    return true;
+  }
+
+  void copy_file(const std::string & from, const std::string & to){
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+  }
+
+  void store(const std::vector<PackedPosition> & packed){
+    std::string path = "/tmp/archive_test_" + std::to_string(getpid()) + ".positions";
+    std::string index = path + ".index", saved = path + ".saved";
+    unlink(path.c_str());
+    unlink(index.c_str());
+    std::vector<PackedPosition> first(packed.begin(), packed.begin() + packed.size() / 2);
+    std::vector<PackedPosition> second(packed.begin() + packed.size() / 2, packed.end());
+
+    PositionStore s;
+    check(s.open(path), "a new store opens");
+    for(const PackedPosition & p: first) s.append(p);
+    std::size_t distinct = s.size();
+    for(const PackedPosition & p: first) s.append(p);
+    check(s.size()==distinct, "appending stored positions again adds nothing");
+    check(all_found(s, first), "every appended position is found");
+    s.close();
+    check(access(index.c_str(), F_OK)==0, "the index is kept next to the store");
+    copy_file(index, saved);
+
+    check(s.open(path) && s.size()==distinct, "a store reopens with its records");
+    check(all_found(s, first), "positions are found through the stored index");
+    for(const PackedPosition & p: second) s.append(p);
+    std::size_t total = s.size();
+    s.close();
+
+    // an index from before the second half was appended, as after a crash
+    copy_file(saved, index);
+    check(s.open(path) && s.size()==total, "a store reopens over a lagging index");
+    check(all_found(s, packed), "a lagging index catches up");
+    s.close();
+
+    unlink(index.c_str());
+    check(s.open(path), "a store reopens without its index");
+    check(all_found(s, packed), "a missing index is rebuilt");
+    s.close();
+
+    std::ofstream(index, std::ios::trunc) << "not an index";
+    check(s.open(path), "a store reopens over a broken index");
+    check(all_found(s, packed), "a broken index is rebuilt");
+    for(const PackedPosition & p: packed) s.append(p);
+    check(s.size()==total, "nothing is stored twice");
+    s.close();
+
+    unlink(path.c_str());
+    unlink(index.c_str());
+    unlink(saved.c_str());
+  }
+}
+
+int main(){
+  std::vector<PackedPosition> packed;
+  played_positions(packed);
+  made_up_boards(packed);
+  store(packed);
+  std::printf("%zu positions, %d failures\n", packed.size(), failures);
+  return failures==0 ? 0 : 1;
+}
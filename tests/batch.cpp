@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "batch.hpp"
+#include "random_games.hpp"
+
+/*
+ * Analyses a batch of positions from random games and random boards, and compares every
+ * result with what the game rules and `evaluate` give for the same position built as a
+ * game, with random network weights so that every accumulator entry counts. The random
+ * boards may have no king or several, and run into more checkmates and draws than games do.
+ */
+
+namespace {
+  int failures = 0;
+
+  void played_positions(PositionBatch & batch){
+    std::mt19937_64 rng(3);
+    random_games(rng, 40, 120, [&batch](Game & g, int, int, Move){ batch.add(g); });
+    // fool's mate
+    Game g;
+    g.make_move(Pos{1,5}, Pos{2,5});
+    g.make_move(Pos{6,4}, Pos{4,4});
+    g.make_move(Pos{1,6}, Pos{3,6});
+    g.make_move(Pos{7,3}, Pos{3,7});
+    batch.add(g);
+  }
+
+  void random_boards(PositionBatch & batch){
+    std::mt19937_64 rng(5);
+    for(int n=0; n<3000; n++){
+      Board board = Board::empty();
+      int pieces = 2 + rng() % 12;
+      for(int k=0; k<pieces; k++){
+	Name name = k < 2 ? KING : Name(rng() % NUM_PIECES);
+	Color color = k < 2 ? Color(k) : Color(rng() % 2);
+	if(n % 10 == 0 && name==KING) name = QUEEN;
+	board.set_piece(StandardGeometry::pos(rng() % StandardGeometry::squares), canonical_piece(name, color));
+      }
+      Game g{board, Color(n % 2)};
+      batch.add(g);
+    }
+  }
+
+  // whether the opponent's moves reach a king of the player to move, as `safe_move` looks
+  bool king_attacked(Game & g){
+    Color player = g.get_turn();
+    MoveSet* attacks = all_moves(g, other_color(player));
+    bool attacked = false;
+    for(const Pos & p: *attacks){
+      Piece* piece = g.board.get_piece(p);
+      attacked = attacked || (piece!=nullptr && piece->color==player && piece->name==KING);
+    }
+    free_move_set(attacks);
+    return attacked;
+  }
+
+  void compare(const PositionBatch & batch, const BatchResults & r){
+    int mates = 0, draws = 0, checks = 0;
+    for(std::size_t i=0; i<batch.size(); i++){
+      ArenaScope scratch;
+      Game g = batch.game(i);
+      MoveList moves;
+      legal_moves(g, moves);
+      int status = in_checkmate(g) ? STATUS_CHECKMATE : in_draw(g) ? STATUS_DRAW
+	: king_attacked(g) ? STATUS_CHECK : STATUS_PLAYING;
+      mates += status==STATUS_CHECKMATE;
+      draws += status==STATUS_DRAW;
+      checks += status==STATUS_CHECK;
+      if(r.legal_moves[i]!=moves.size() || r.status[i]!=status || r.evaluation[i]!=evaluate(g)){
+	std::printf("position %zu: %d moves, status %d, evaluation %d; the game has %zu, %d, %d\n", i,
+		    r.legal_moves[i], r.status[i], r.evaluation[i], moves.size(), status, evaluate(g));
+	failures++;
+      }
+    }
+    std::printf("%zu positions, %d checkmates, %d draws, %d checks\n", batch.size(), mates, draws, checks);
+    if(mates==0 || draws==0 || checks==0){
+      std::printf("the positions don't cover every status\n");
+      failures++;
+    }
+  }
+}
+
+int main(){
+  std::mt19937_64 rng(1);
+  random_network(rng);
+  PositionBatch batch;
+  played_positions(batch);
+  random_boards(batch);
+  BatchResults one, many;
+  analyse_batch(batch, one, 1);
+  compare(batch, one);
+  analyse_batch(batch, many, 4);
+  if(many.legal_moves!=one.legal_moves || many.status!=one.status || many.evaluation!=one.evaluation){
+    std::printf("threads change the results\n");
+    failures++;
+  }
+  std::printf("%d failures\n", failures);
+  return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "random_games.hpp"
+
+/*
+ * Plays the same random games with every set of evaluation kernels this build has and this
+ * processor runs, and checks that they keep identical accumulators and scores, both updated
+ * move by move and recomputed from scratch.
+ */
+
+namespace {
+  const int GAMES = 20;
+  const int PLIES = 80;
+  int failures = 0;
+
+  /*
+   * The accumulator and the score at every position of the games. An accumulator that
+   * differs from one recomputed from scratch is a failure of its own, whatever the other
+   * kernels do, since a slip in the incremental updates would be the same for all of them.
+   */
+  std::vector<std::int32_t> play(){
+    std::vector<std::int32_t> trace;
+    std::mt19937_64 rng(2);
+    random_games(rng, GAMES, PLIES, [&trace](Game & g, int game, int ply, Move last){
+      Accumulator fresh;
+      accumulator_refresh(fresh, g.board);
+      if(std::memcmp(fresh.values, g.accumulator.values, sizeof(fresh.values))!=0){
+	std::printf("%s: accumulator drifted in game %d after move %d, %s\n", nnue_kernels(), game, ply,
+		    move_name(last).c_str());
+	failures++;
+      }
+      trace.insert(trace.end(), g.accumulator.values, g.accumulator.values + ACCUMULATOR_SIZE);
+      trace.push_back(evaluate(g));
+    });
+    return trace;
+  }
+}
+
+int main(){
+  std::mt19937_64 rng(1);
+  random_network(rng);
+  std::printf("default kernels: %s\n", nnue_kernels());
+
+  use_nnue_kernels("scalar");
+  std::vector<std::int32_t> expected = play();
+  int tried = 0;
+  for(const char* name: {"scalar", "sse2", "avx2"}){
+    if(!use_nnue_kernels(name)){
+      std::printf("%s: not available\n", name);
+      continue;
+    }
+    tried++;
+    bool same = play()==expected;
+    std::printf("%s: %s\n", name, same ? "ok" : "differs from scalar");
+    failures += !same;
+  }
+  return failures==0 && tried > 0 ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+#include <cstdint>
+#include <cstdio>
+#include "chess.hpp"
+
+/*
+ * Counts the positions a few plies from the start, on the standard board and on the wider
+ * boards in geometry.hpp, and compares them with counts made by a separate move generator.
+ * The rules have no castling, en passant or promotion, none of which can happen in the
+ * first four plies, so the standard counts are the usual perft figures.
+ */
+
+namespace {
+  int failures = 0;
+
+  template <class G>
+  std::uint64_t perft(BasicGame<G> & g, int depth){
+    ArenaScope scratch;
+    MoveList moves;
+    legal_moves(g, moves);
+    if(depth==1) return moves.size();
+    std::uint64_t count = 0;
+    for(const Move & m: moves){
+      BasicUndo<G> u = g.make_move(m.from, m.to);
+      count += perft(g, depth - 1);
+      g.unmake_move(u);
+    }
+    return count;
+  }
+
+  template <class G>
+  void check(const char* board, bool fairy, int depth, std::uint64_t expected){
+    BasicGame<G> g{fairy};
+    std::uint64_t key = g.key;
+    std::uint64_t count = perft(g, depth);
+    if(count!=expected){
+      std::printf("%s%s perft(%d): expected %llu, got %llu\n", board, fairy ? " fairy" : "", depth,
+		  (unsigned long long)expected, (unsigned long long)count);
+      failures++;
+    }
+    if(g.key!=key || g.key!=zobrist_key(g)){
+      std::printf("%s%s perft(%d): the key changed\n", board, fairy ? " fairy" : "", depth);
+      failures++;
+    }
+  }
+}
+
+int main(){
+  check<StandardGeometry>("8x8", false, 3, 8902);
+  check<StandardGeometry>("8x8", false, 4, 197281);
+  check<StandardGeometry>("8x8", true, 3, 12465);
+  check<CapablancaGeometry>("10x8", false, 3, 15374);
+  check<CapablancaGeometry>("10x8", true, 3, 25535);
+  check<GrandGeometry>("10x10", false, 3, 15384);
+  check<GrandGeometry>("10x10", true, 3, 26420);
+  std::printf("%d failures\n", failures);
+  return failures==0 ? 0 : 1;
+}
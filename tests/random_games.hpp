@@ -0,0 +1,47 @@
+#ifndef RANDOM_GAMES_H
+#define RANDOM_GAMES_H
+#include <random>
+#include "nnue.hpp"
+
+/*
+ * Fixtures shared by the tests: random network weights, and positions from random games.
+ */
+
+/**
+ * Fills the global network with random weights, so that every accumulator entry and
+ * output weight counts in evaluations.
+ */
+inline void random_network(std::mt19937_64 & rng){
+  std::uniform_int_distribution<int> feature(-64, 64), output(-2000, 2000);
+  for(auto& row: network.feature_weights)
+    for(auto& w: row) w = feature(rng);
+  for(auto& b: network.feature_bias) b = feature(rng);
+  for(auto& w: network.output_weights) w = output(rng);
+  network.output_bias = output(rng);
+}
+
+/**
+ * Plays random legal moves in `games` games, standard and fairy in turn, for at most
+ * `plies` moves each or until the player to move has none. `visit(g, game, ply, last)` is
+ * called on every position before its move is chosen, the starting one included, with the
+ * move that led to it, `Move{invalid, invalid}` at the start. It runs inside an
+ * `ArenaScope` that lasts until the next move is made.
+ */
+template <class Visit>
+void random_games(std::mt19937_64 & rng, int games, int plies, Visit visit){
+  for(int game=0; game<games; game++){
+    Game g{game % 2 == 1};
+    Move last {invalid, invalid};
+    for(int ply=0; ply<plies; ply++){
+      ArenaScope scratch;
+      visit(g, game, ply, last);
+      MoveList moves;
+      legal_moves(g, moves);
+      if(moves.empty()) break;
+      last = moves[rng() % moves.size()];
+      g.make_move(last.from, last.to);
+    }
+  }
+}
+
+#endif
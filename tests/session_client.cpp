@@ -0,0 +1,202 @@
+// session_client.cpp
+// Starts a session_server and plays a scripted conversation with it over its socket.
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+  const char* START =
+    "RNBQKBNR" "PPPPPPPP" "........" "........" "........" "........" "pppppppp" "rnbqkbnr";
+  const char* AFTER_E4 =
+    "RNBQKBNR" "PPPP.PPP" "........" "....P..." "........" "........" "pppppppp" "rnbqkbnr";
+
+  int failures = 0;
+
+  /*
+   * A blocking connection to the server that reads its answers line by line.
+   */
+  class Client{
+  public:
+    bool connect_to(const std::string & path){
+      sockaddr_un address {};
+      address.sun_family = AF_UNIX;
+      std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+      // the server may still be starting
+      for(int attempt=0; attempt<100; attempt++){
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address))==0) return true;
+	if(fd >= 0) close(fd);
+	fd = -1;
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      }
+      return false;
+    }
+
+    ~Client(){
+      if(fd >= 0) close(fd);
+    }
+
+    bool send_raw(const std::string & text){
+      std::size_t done = 0;
+      while(done < text.size()){
+	ssize_t sent = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+	if(sent < 0 && errno==EINTR) continue;
+	if(sent <= 0) return false;
+	done += sent;
+      }
+      return true;
+    }
+
+    // the next answer without its newline, empty if the server hung up
+    std::string read_line(){
+      std::size_t end;
+      while((end = buffered.find('\n')) == std::string::npos){
+	char chunk[4096];
+	ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+	if(got < 0 && errno==EINTR) continue;
+	if(got <= 0) return "";
+	buffered.append(chunk, got);
+      }
+      std::string line = buffered.substr(0, end);
+      buffered.erase(0, end + 1);
+      return line;
+    }
+
+    // tells the server nothing more will be sent, leaving the answers to read
+    void finish(){
+      shutdown(fd, SHUT_WR);
+    }
+
+    std::string ask(const std::string & request){
+      return send_raw(request + "\n") ? read_line() : "";
+    }
+  private:
+    int fd = -1;
+    std::string buffered;
+  };
+
+  void expect(const std::string & request, const std::string & answer, const std::string & expected){
+    if(answer==expected) return;
+    std::printf("%s: expected \"%s\", got \"%s\"\n", request.c_str(), expected.c_str(), answer.c_str());
+    failures++;
+  }
+
+  void check(Client & client, const std::string & request, const std::string & expected){
+    expect(request, client.ask(request), expected);
+  }
+
+  // an answer that starts with `prefix`, returning the rest
+  std::string check_prefix(Client & client, const std::string & request, const std::string & prefix){
+    std::string answer = client.ask(request);
+    if(answer.compare(0, prefix.size(), prefix)==0) return answer.substr(prefix.size());
+    std::printf("%s: expected \"%s...\", got \"%s\"\n", request.c_str(), prefix.c_str(), answer.c_str());
+    failures++;
+    return "";
+  }
+
+  void converse(Client & client){
+    std::string id = check_prefix(client, "NEW", "OK ");
+    check(client, "SHOW " + id, std::string("OK w ") + START);
+    check(client, "MOVE " + id + " e2 e4", "OK PLAYING");
+    check(client, "SHOW " + id, std::string("OK b ") + AFTER_E4);
+    check(client, "MOVE " + id + " e4 e5", "ERR illegal move");
+    check(client, "MOVE " + id + " e7 x9", "ERR bad square");
+    check(client, "UNDO " + id, "OK");
+    check(client, "SHOW " + id, std::string("OK w ") + START);
+    check(client, "UNDO " + id, "ERR nothing to undo");
+    check(client, "REDO " + id, "OK");
+    check(client, "SHOW " + id, std::string("OK b ") + AFTER_E4);
+    check(client, "REDO " + id, "ERR nothing to redo");
+    // black resigns, a point for white, and the game starts again
+    check(client, "RESIGN " + id, "OK 1 0");
+    check(client, "SHOW " + id, std::string("OK w ") + START);
+    check(client, "JUMP " + id, "ERR unknown command");
+    check(client, "CLOSE " + id, "OK");
+    check(client, "SHOW " + id, "ERR no such game");
+    check(client, "SHOW", "ERR bad request");
+
+    // requests split across writes and several in one write
+    std::string other = check_prefix(client, "NEW fairy", "OK ");
+    client.send_raw("SHOW " + other.substr(0, 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    client.send_raw(other.substr(1) + "\nMOVE " + other + " d2 d4\nSHOW " + other + "\nCLOSE " + other + "\n");
+    expect("(split) SHOW", client.read_line().substr(0, 5), "OK w ");
+    expect("(pipelined) MOVE", client.read_line(), "OK PLAYING");
+    std::string board = client.read_line();
+    expect("(pipelined) SHOW", board.substr(0, 13), "OK b SDBQKBDS");
+    expect("(pipelined) CLOSE", client.read_line(), "OK");
+  }
+
+  /*
+   * Sends more requests than the socket buffers hold answers for, then stops sending before
+   * reading any answer. The server has to keep writing after it reads the end of the input.
+   */
+  void finish_early(Client & client){
+    const int REQUESTS = 20000;
+    std::string id = check_prefix(client, "NEW", "OK ");
+    std::string requests;
+    for(int n=0; n<REQUESTS; n++) requests += "SHOW " + id + "\n";
+    client.send_raw(requests);
+    client.finish();
+    int answers = 0;
+    while(client.read_line()==std::string("OK w ") + START) answers++;
+    if(answers!=REQUESTS){
+      std::printf("after the client stopped sending: expected %d answers, got %d\n", REQUESTS, answers);
+      failures++;
+    }
+  }
+}
+
+int main(int argc, char* argv[]){
+  if(argc < 2){
+    std::fprintf(stderr, "usage: session_client <session_server binary>\n");
+    return 1;
+  }
+  std::string path = "/tmp/session_client_" + std::to_string(getpid()) + ".sock";
+  pid_t server = fork();
+  if(server==0){
+    execl(argv[1], argv[1], path.c_str(), "2", static_cast<char*>(nullptr));
+    std::perror(argv[1]);
+    _exit(127);
+  }
+  if(server < 0){
+    std::perror("fork");
+    return 1;
+  }
+
+  {
+    Client client, finishing;
+    if(client.connect_to(path) && finishing.connect_to(path)){
+      converse(client);
+      finish_early(finishing);
+    }
+    else{
+      std::printf("could not connect to %s\n", path.c_str());
+      failures++;
+    }
+  }
+
+  kill(server, SIGTERM);
+  int status = 0;
+  waitpid(server, &status, 0);
+  if(!WIFEXITED(status) || WEXITSTATUS(status)!=0){
+    std::printf("server did not exit cleanly\n");
+    failures++;
+  }
+  if(access(path.c_str(), F_OK)==0){
+    std::printf("server left its socket behind\n");
+    unlink(path.c_str());
+    failures++;
+  }
+  std::printf("%d failures\n", failures);
+  return failures==0 ? 0 : 1;
+}
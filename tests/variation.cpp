@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <random>
+#include "chess.hpp"
+
+/*
+ * Plays two lines of 20 plies from the start in a VariationTree, longer than the distance
+ * between its checkpoints, and walks them with undo, redo and next_line. After every step
+ * the game must be at the position of the node the tree is on, and redo must follow the
+ * line visited last all the way from the root.
+ */
+
+namespace {
+  const int PLIES = 20;
+  int failures = 0;
+
+  void check(bool ok, const char* what){
+    if(ok) return;
+    std::printf("failed: %s\n", what);
+    failures++;
+  }
+
+  // a line of random legal moves, starting with `first`
+  std::vector<Move> line(Move first, unsigned seed){
+    std::mt19937_64 rng(seed);
+    std::vector<Move> moves {first};
+    Game g;
+    g.make_move(first.from, first.to);
+    while(moves.size() < PLIES){
+      ArenaScope scratch;
+      MoveList legal;
+      legal_moves(g, legal);
+      Move m = legal[rng() % legal.size()];
+      g.make_move(m.from, m.to);
+      moves.push_back(m);
+    }
+    return moves;
+  }
+
+  Game replay(const std::vector<Move> & moves, std::size_t plies){
+    Game g;
+    for(std::size_t i=0; i<plies; i++) g.make_move(moves[i].from, moves[i].to);
+    return g;
+  }
+
+  bool same_position(Game & a, Game b){
+    return a.key==b.key && a.get_turn()==b.get_turn();
+  }
+}
+
+int main(){
+  std::vector<Move> a = line(Move{Pos{1,4}, Pos{3,4}}, 1);
+  std::vector<Move> b = line(Move{Pos{1,3}, Pos{3,3}}, 2);
+  Game g;
+  VariationTree tree;
+  tree.reset(g);
+
+  for(const Move & m: a) tree.play(g, m);
+  check(tree.current_node()==PLIES && same_position(g, replay(a, PLIES)), "line A is played");
+  for(int i=0; i<PLIES; i++) tree.undo(g);
+  check(tree.at_root() && same_position(g, Game{}), "undo goes back to the start");
+  check(!tree.undo(g), "undo stops at the start");
+  for(int i=0; i<PLIES; i++) tree.redo(g);
+  check(tree.current_node()==PLIES && same_position(g, replay(a, PLIES)), "redo replays line A");
+  check(!tree.redo(g), "redo stops at the end of the line");
+
+  for(int i=0; i<PLIES; i++) tree.undo(g);
+  for(const Move & m: b) tree.play(g, m);
+  check(tree.current_node()==2*PLIES && same_position(g, replay(b, PLIES)), "line B is played");
+  check(tree.size()==2*PLIES + 1, "the lines share only the start");
+
+  check(tree.next_line(g), "there is another line");
+  check(tree.current_node()==PLIES && same_position(g, replay(a, PLIES)), "next_line goes to the end of A");
+  for(int i=0; i<PLIES; i++) tree.undo(g);
+  for(int i=0; i<PLIES; i++) tree.redo(g);
+  check(tree.current_node()==PLIES && same_position(g, replay(a, PLIES)),
+	"redo from the start follows the line visited last");
+
+  check(tree.next_line(g) && tree.current_node()==2*PLIES, "next_line goes back to the end of B");
+  for(int i=0; i<PLIES; i++) tree.undo(g);
+  tree.play(g, a[0]);
+  check(tree.current_node()==1, "a move played before is followed, not added");
+  for(int i=1; i<PLIES; i++) tree.redo(g);
+  check(tree.current_node()==PLIES && same_position(g, replay(a, PLIES)), "redo then follows that line");
+  check(tree.size()==2*PLIES + 1, "no node is added twice");
+
+  std::printf("%d failures\n", failures);
+  return failures==0 ? 0 : 1;
+}
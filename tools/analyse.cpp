@@ -0,0 +1,43 @@
+// analyse.cpp
+// Analyses every position in a position store and prints one line per position.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "archive.hpp"
+#include "batch.hpp"
+#include "nnue.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]){
+  if(argc < 2){
+    std::cerr << "usage: analyse <position store> [threads] [weights file]\n"
+      "prints: record legal_moves status evaluation material\n";
+    return 1;
+  }
+  int threads = argc > 2 ? std::atoi(argv[2]) : 0;
+  if(argc > 3 && !load_network(argv[3])) return 1;
+
+  PositionStore store;
+  if(!store.open(argv[1])) return 1;
+  PositionBatch batch;
+  for(std::size_t record=0; record<store.size(); record++) batch.add(store.at(record));
+
+  BatchResults results;
+  auto start = Clock::now();
+  analyse_batch(batch, results, threads);
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  const char* status_names[] = {"playing", "check", "checkmate", "draw"};
+  for(std::size_t i=0; i<batch.size(); i++){
+    std::printf("%zu %d %s %d %d\n", i, results.legal_moves[i], status_names[results.status[i]],
+		results.evaluation[i], results.material[i]);
+  }
+  std::fprintf(stderr, "%zu positions in %.3f s, %.0f positions/s\n",
+	       batch.size(), seconds, seconds > 0 ? batch.size() / seconds : 0.0);
+  return 0;
+}
@@ -0,0 +1,157 @@
+// session_server.cpp
+// Serves many concurrent games over a local socket, one event loop per core.
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "session.hpp"
+
+std::atomic<bool> running{true};
+
+void stop_running(int){
+  running = false;
+}
+
+/**
+ * What a worker knows about one client: the part of a request line read so far, the
+ * answers the socket has not taken yet, whether the client has stopped sending and the
+ * events epoll is watching for.
+ */
+struct Connection{
+  std::string input;
+  std::string output;
+  bool finished = false;
+  std::uint32_t events = EPOLLIN | EPOLLRDHUP;
+};
+
+/*
+ * Sends as much pending output as the socket takes. epoll then watches for requests
+ * until the client stops sending, and for room to write while anything is left; it is
+ * only told when that changes.
+ */
+bool flush(int epoll, int fd, Connection & c){
+  while(!c.output.empty()){
+    ssize_t sent = send(fd, c.output.data(), c.output.size(), MSG_NOSIGNAL);
+    if(sent < 0){
+      if(errno==EAGAIN || errno==EWOULDBLOCK) break;
+      return false;
+    }
+    c.output.erase(0, sent);
+  }
+  std::uint32_t events = (c.finished ? 0 : std::uint32_t(EPOLLIN | EPOLLRDHUP))
+    | (c.output.empty() ? 0 : std::uint32_t(EPOLLOUT));
+  if(events==c.events) return true;
+  epoll_event e {};
+  e.events = events;
+  e.data.fd = fd;
+  c.events = events;
+  return epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &e) == 0;
+}
+
+/*
+ * One event loop. Every worker waits on the listening socket too, and the kernel hands
+ * each new client to a single worker, which then serves it until it disconnects.
+ */
+void serve(int listener, SessionStore & store){
+  int epoll = epoll_create1(0);
+  epoll_event e {};
+  e.events = EPOLLIN | EPOLLEXCLUSIVE;
+  e.data.fd = listener;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &e);
+
+  std::unordered_map<int, Connection> connections;
+  epoll_event events[64];
+  char buffer[4096];
+  while(running){
+    int ready = epoll_wait(epoll, events, 64, 200);
+    for(int i=0; i<ready; i++){
+      int fd = events[i].data.fd;
+      if(fd==listener){
+	int client;
+	while((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+	  epoll_event ce {};
+	  ce.events = EPOLLIN | EPOLLRDHUP;
+	  ce.data.fd = client;
+	  epoll_ctl(epoll, EPOLL_CTL_ADD, client, &ce);
+	  connections[client];
+	}
+	continue;
+      }
+
+      // a client that has stopped sending still gets the answers to what it sent
+      Connection& c = connections[fd];
+      bool open = true;
+      if((events[i].events & (EPOLLIN | EPOLLRDHUP)) && !c.finished){
+	ssize_t got;
+	while((got = recv(fd, buffer, sizeof(buffer), 0)) > 0) c.input.append(buffer, got);
+	if(got==0) c.finished = true;
+	else if(got < 0 && errno!=EAGAIN && errno!=EWOULDBLOCK) open = false;
+	std::size_t start = 0, end;
+	while((end = c.input.find('\n', start)) != std::string::npos){
+	  c.output += store.handle(c.input.substr(start, end - start));
+	  c.output += '\n';
+	  start = end + 1;
+	}
+	c.input.erase(0, start);
+      }
+      if(events[i].events & (EPOLLHUP | EPOLLERR)) open = false;
+      if(!flush(epoll, fd, c) || !open || (c.finished && c.output.empty())){
+	epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+	close(fd);
+	connections.erase(fd);
+      }
+    }
+  }
+  for(auto& connection: connections) close(connection.first);
+  close(epoll);
+}
+
+int main(int argc, char* argv[]){
+  if(argc < 2){
+    std::cerr << "usage: session_server <socket path> [threads]\n";
+    return 1;
+  }
+  std::string path = argv[1];
+  int threads = argc > 2 ? std::atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+  sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(address.sun_path)){
+    std::cerr << path << ": socket path too long\n";
+    return 1;
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(path.c_str());
+  if(listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+     || listen(listener, SOMAXCONN) < 0){
+    std::perror(path.c_str());
+    return 1;
+  }
+  std::signal(SIGINT, stop_running);
+  std::signal(SIGTERM, stop_running);
+
+  SessionStore store;
+  std::vector<std::thread> workers;
+  for(int t=0; t<std::max(1, threads); t++) workers.emplace_back(serve, listener, std::ref(store));
+  for(std::thread& w: workers) w.join();
+
+  close(listener);
+  unlink(path.c_str());
+  return 0;
+}
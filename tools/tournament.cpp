@@ -0,0 +1,259 @@
+// tournament.cpp
+// Plays two engine settings against each other on many threads and reports which is stronger.
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.hpp"
+#include "chess.hpp"
+#include "nnue.hpp"
+#include "search.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * One side of the match: how long it may think per move.
+ */
+struct Engine{
+  SearchLimits limits;
+  std::uint64_t nodes = 0;
+  double seconds = 0;
+};
+
+struct Options{
+  int games = 200;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  bool fairy = false;
+  int max_plies = 200;
+  int random_plies = 4;
+  std::uint64_t seed = 1;
+  std::size_t hash = 1 << 16;
+  double elo0 = 0;
+  double elo1 = 5;
+  double alpha = 0.05;
+  double beta = 0.05;
+  std::string archive;
+  Engine a;
+  Engine b;
+};
+
+/**
+ * Results from engine A's point of view, plus what each engine spent.
+ */
+struct Results{
+  int wins = 0;
+  int draws = 0;
+  int losses = 0;
+  Engine a;
+  Engine b;
+};
+
+enum Outcome {WHITE_WINS, BLACK_WINS, DRAWN};
+
+void usage(){
+  std::cerr <<
+    "usage: tournament [options]\n"
+    "  --games N            games to play (default 200)\n"
+    "  --threads N          worker threads (default: one per core)\n"
+    "  --fairy              play every other pair of games from the fairy start\n"
+    "  --nodes-a N, --nodes-b N    node budget per move (default 2000, 0 for none)\n"
+    "  --millis-a N, --millis-b N  time budget per move in milliseconds\n"
+    "  --depth-a N, --depth-b N    depth limit per move\n"
+    "  --max-plies N        adjudicate a draw after N plies (default 200)\n"
+    "  --random-plies N     random opening moves per game pair (default 4)\n"
+    "  --seed N             seed for the openings\n"
+    "  --hash N             transposition table entries per engine\n"
+    "  --elo0 E --elo1 E    SPRT hypotheses in Elo (default 0 and 5)\n"
+    "  --alpha P --beta P   SPRT error rates (default 0.05)\n"
+    "  --nnue FILE          evaluation weights\n"
+    "  --archive FILE       add every position played to a position store\n";
+}
+
+/*
+ * Plays one game. The opening moves are random but seeded by the pair, so both games
+ * of a pair start from the same position with colours reversed. When archiving, every
+ * position reached is added to `positions`.
+ */
+Outcome play(const Options& o, int index, Search& a, Search& b, Engine& a_spent, Engine& b_spent,
+	     std::vector<PackedPosition>& positions){
+  int pair = index / 2;
+  bool a_white = index % 2 == 0;
+  Game g {o.fairy && pair % 2 == 1};
+  std::mt19937_64 rng(o.seed * 0x9E3779B97F4A7C15ull + pair);
+  a.clear();
+  b.clear();
+
+  std::unordered_map<std::uint64_t, int> seen;
+  for(int ply=0; ply<o.max_plies; ply++){
+    ArenaScope scratch;
+    if(!o.archive.empty()){
+      positions.emplace_back();
+      if(!pack(g, positions.back())) positions.pop_back();
+    }
+    MoveList moves;
+    legal_moves(g, moves);
+    if(moves.empty()){
+      // as in_checkmate and in_draw
+      if(!has_possible_moves(g, other_color(g.get_turn()))) return DRAWN;
+      return g.get_turn()==WHITE ? BLACK_WINS : WHITE_WINS;
+    }
+    if(++seen[g.key] >= 3) return DRAWN;
+
+    Move m = moves[0];
+    if(ply < o.random_plies){
+      m = moves[rng() % moves.size()];
+    }
+    else{
+      bool a_to_move = (g.get_turn()==WHITE) == a_white;
+      Search& s = a_to_move ? a : b;
+      Engine& spent = a_to_move ? a_spent : b_spent;
+      auto start = Clock::now();
+      SearchInfo info = s.run(g, (a_to_move ? o.a : o.b).limits);
+      spent.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+      spent.nodes += s.nodes();
+      if(!info.pv.empty()) m = info.pv[0];
+    }
+    g.make_move(m.from, m.to);
+  }
+  return DRAWN;
+}
+
+double elo(double score){
+  return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+void report(const Options& o, const Results& r, double wall){
+  int n = r.wins + r.draws + r.losses;
+  double score = (r.wins + 0.5 * r.draws) / n;
+  double variance = (r.wins * (1 - score) * (1 - score)
+		     + r.draws * (0.5 - score) * (0.5 - score)
+		     + r.losses * score * score) / n;
+  double error = std::sqrt(variance / n);
+
+  std::printf("games %d  wins %d  draws %d  losses %d  score %.1f%%\n",
+	      n, r.wins, r.draws, r.losses, 100 * score);
+  if(score > 0 && score < 1){
+    double low = std::max(score - 1.96 * error, 1e-6);
+    double high = std::min(score + 1.96 * error, 1 - 1e-6);
+    std::printf("elo %+.1f +/- %.1f (95%%)\n", elo(score), (elo(high) - elo(low)) / 2);
+  }
+  else std::printf("elo %s\n", score > 0 ? "+inf" : "-inf");
+
+  // sequential probability ratio test, normal approximation of the game scores
+  double s0 = 1 / (1 + std::pow(10, -o.elo0 / 400));
+  double s1 = 1 / (1 + std::pow(10, -o.elo1 / 400));
+  double lower = std::log(o.beta / (1 - o.alpha));
+  double upper = std::log((1 - o.beta) / o.alpha);
+  double llr = variance > 0 ? n * (s1 - s0) * (2 * score - s0 - s1) / (2 * variance) : 0;
+  const char* verdict = llr >= upper ? "H1 accepted (A is stronger)"
+    : llr <= lower ? "H0 accepted (A is not stronger)" : "inconclusive";
+  std::printf("sprt [%.1f, %.1f]  llr %.2f  bounds [%.2f, %.2f]  %s\n",
+	      o.elo0, o.elo1, llr, lower, upper, verdict);
+
+  auto nps = [](const Engine& e){ return e.seconds > 0 ? e.nodes / e.seconds : 0.0; };
+  std::printf("engine A  %llu nodes  %.0f nodes/s\n", (unsigned long long)r.a.nodes, nps(r.a));
+  std::printf("engine B  %llu nodes  %.0f nodes/s\n", (unsigned long long)r.b.nodes, nps(r.b));
+  std::printf("total     %.0f nodes/s over %.1f s on %d threads\n",
+	      (r.a.nodes + r.b.nodes) / wall, wall, o.threads);
+}
+
+bool parse(int argc, char* argv[], Options& o){
+  for(int i=1; i<argc; i++){
+    std::string arg = argv[i];
+    if(arg=="--fairy"){
+      o.fairy = true;
+      continue;
+    }
+    if(i + 1 >= argc) return false;
+    std::string value = argv[++i];
+    if(arg=="--games") o.games = std::stoi(value);
+    else if(arg=="--threads") o.threads = std::stoi(value);
+    else if(arg=="--nodes-a") o.a.limits.nodes = std::stoull(value);
+    else if(arg=="--nodes-b") o.b.limits.nodes = std::stoull(value);
+    else if(arg=="--millis-a") o.a.limits.millis = std::stoi(value);
+    else if(arg=="--millis-b") o.b.limits.millis = std::stoi(value);
+    else if(arg=="--depth-a") o.a.limits.depth = std::stoi(value);
+    else if(arg=="--depth-b") o.b.limits.depth = std::stoi(value);
+    else if(arg=="--max-plies") o.max_plies = std::stoi(value);
+    else if(arg=="--random-plies") o.random_plies = std::stoi(value);
+    else if(arg=="--seed") o.seed = std::stoull(value);
+    else if(arg=="--hash") o.hash = std::stoull(value);
+    else if(arg=="--elo0") o.elo0 = std::stod(value);
+    else if(arg=="--elo1") o.elo1 = std::stod(value);
+    else if(arg=="--alpha") o.alpha = std::stod(value);
+    else if(arg=="--beta") o.beta = std::stod(value);
+    else if(arg=="--archive") o.archive = value;
+    else if(arg=="--nnue"){
+      if(!load_network(value)) return false;
+    }
+    else return false;
+  }
+  return o.games > 0 && o.threads > 0;
+}
+
+int main(int argc, char* argv[]){
+  Options o;
+  // without any budget a search would never end
+  o.a.limits.nodes = o.b.limits.nodes = 2000;
+  try{
+    if(!parse(argc, argv, o)){
+      usage();
+      return 1;
+    }
+  }
+  catch(const std::exception&){
+    usage();
+    return 1;
+  }
+
+  PositionStore archive;
+  if(!o.archive.empty() && !archive.open(o.archive)) return 1;
+  std::size_t archived_before = archive.size();
+
+  Results results;
+  std::mutex results_lock;
+  std::atomic<int> next_game{0};
+  auto start = Clock::now();
+
+  // every worker owns its engines and games, and only shares the totals
+  auto worker = [&](){
+    Search a {o.hash};
+    Search b {o.hash};
+    for(int i = next_game++; i < o.games; i = next_game++){
+      Engine a_spent, b_spent;
+      std::vector<PackedPosition> positions;
+      Outcome outcome = play(o, i, a, b, a_spent, b_spent, positions);
+      bool a_white = i % 2 == 0;
+      std::lock_guard<std::mutex> guard(results_lock);
+      for(const PackedPosition& p: positions) archive.append(p);
+      if(outcome==DRAWN) results.draws++;
+      else if((outcome==WHITE_WINS) == a_white) results.wins++;
+      else results.losses++;
+      results.a.nodes += a_spent.nodes;
+      results.a.seconds += a_spent.seconds;
+      results.b.nodes += b_spent.nodes;
+      results.b.seconds += b_spent.seconds;
+      int played = results.wins + results.draws + results.losses;
+      if(played % 10 == 0) std::fprintf(stderr, "%d/%d games\n", played, o.games);
+    }
+  };
+  std::vector<std::thread> threads;
+  for(int t=0; t<o.threads; t++) threads.emplace_back(worker);
+  for(std::thread& t: threads) t.join();
+
+  report(o, results, std::chrono::duration<double>(Clock::now() - start).count());
+  if(archive.is_open()){
+    std::printf("archived %zu new positions, %zu in %s\n",
+		archive.size() - archived_before, archive.size(), o.archive.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include "chess.hpp"
+
+VariationTree :: VariationTree():
+  nodes{}
+  , checkpoints{}
+  , current{0}
+{}
+
+/**
+ * Forgets every line and starts a new tree at a position.
+ * @param g the game, at the position the tree should start from
+ */
+void VariationTree :: reset(Game & g){
+  nodes.assign(1, Node{Move{invalid, invalid}, nullptr, none, none, none, none, 0});
+  checkpoints.clear();
+  checkpoints.emplace(0, g);
+  current = 0;
+}
+
+/**
+ * Makes a move on the game and steps to its node, adding the node if the move has not
+ * been played from here before.
+ * @param g the game, at the position of the current node
+ * @param m the move, which is not checked
+ */
+void VariationTree :: play(Game & g, Move m){
+  Undo u = g.make_move(m.from, m.to);
+  std::uint32_t child = nodes[current].first_child;
+  while(child!=none && !(nodes[child].move.from==m.from && nodes[child].move.to==m.to)){
+    child = nodes[child].next_sibling;
+  }
+  if(child==none){
+    child = nodes.size();
+    std::uint32_t ply = nodes[current].ply + 1;
+    nodes.push_back(Node{m, u.captured, current, none, nodes[current].first_child, none, ply});
+    nodes[current].first_child = child;
+    if(ply % checkpoint_interval == 0) checkpoints.emplace(child, g);
+  }
+  nodes[current].last_visited = child;
+  current = child;
+}
+
+/**
+ * Takes back the move that led to the current node. The line stays in the tree.
+ * @return false at the root
+ */
+bool VariationTree :: undo(Game & g){
+  if(current==0) return false;
+  const Node& n = nodes[current];
+  g.unmake_move(Undo{n.move.from, n.move.to, n.captured});
+  current = n.parent;
+  return true;
+}
+
+/**
+ * Replays the line visited last from the current node.
+ * @return false if no move has been played from here
+ */
+bool VariationTree :: redo(Game & g){
+  std::uint32_t child = nodes[current].last_visited;
+  if(child==none) return false;
+  g.make_move(nodes[child].move.from, nodes[child].move.to);
+  current = child;
+  return true;
+}
+
+/**
+ * Switches to another line: the next alternative to the latest move on the way to the
+ * current node that has one, followed to where that line was last left.
+ * @return false if the game has never branched
+ */
+bool VariationTree :: next_line(Game & g){
+  std::uint32_t branch = current;
+  while(branch!=0){
+    const Node& parent = nodes[nodes[branch].parent];
+    if(parent.first_child!=branch || nodes[branch].next_sibling!=none) break;
+    branch = nodes[branch].parent;
+  }
+  if(branch==0) return false;
+  std::uint32_t next = nodes[branch].next_sibling;
+  if(next==none) next = nodes[nodes[branch].parent].first_child;
+  while(nodes[next].last_visited!=none) next = nodes[next].last_visited;
+  jump(g, next);
+  return true;
+}
+
+/**
+ * Moves to any node. The position is rebuilt from the closest checkpoint above it, and
+ * the whole path to it from the root becomes the line `redo` follows.
+ * @param g the game, set to the position of the node
+ * @param node the node to go to
+ */
+void VariationTree :: jump(Game & g, std::uint32_t node){
+  for(std::uint32_t n = node; n!=0; n = nodes[n].parent) nodes[nodes[n].parent].last_visited = n;
+  std::vector<std::uint32_t> path;
+  std::uint32_t n = node;
+  while(checkpoints.find(n)==checkpoints.end()){
+    path.push_back(n);
+    n = nodes[n].parent;
+  }
+  g = checkpoints.at(n);
+  for(auto it = path.rbegin(); it != path.rend(); ++it){
+    g.make_move(nodes[*it].move.from, nodes[*it].move.to);
+  }
+  current = node;
+}
+
+bool VariationTree :: at_root() const{
+  return current==0;
+}
+
+std::uint32_t VariationTree :: current_node() const{
+  return current;
+}
+
+/**
+ * @return the number of positions in the tree, the starting one included
+ */
+std::size_t VariationTree :: size() const{
+  return nodes.size();
+}